@@ -3,6 +3,861 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+
+#define INDEX_INIT_CAPACITY 64 // 哈希表初始槽位数（必须是2的幂）
+#define GRAM_LEN 3              // n-gram长度（按UTF-8字节计，一个汉字恰好3字节）
+#define MAX_QUERY_GRAMS 128     // 单次查询最多使用的三元组数量
+#define SLAB_CHUNK_NODES 1024   // 每块slab容纳的节点数
+
+// 索引槽：紧凑ISBN键 + 节点指针，node为NULL表示空槽
+typedef struct {
+    IsbnKey key;    // isbn_pack的结果，ISBN_KEY_NONE表示走字符串比较
+    BookNode *node; // 对应的图书节点
+    uint32_t id;    // 图书编号（nodes数组下标）
+} IndexSlot;
+
+// 三元组倒排表：一个三元组对应的图书编号列表（编号按插入顺序递增）
+typedef struct {
+    uint32_t gram;  // 三个字节拼成的24位键再+1，0表示空槽
+    uint32_t len;   // 编号个数
+    uint32_t cap;   // ids容量
+    uint32_t *ids;  // 图书编号（即nodes数组下标），升序
+} Posting;
+
+// slab块：一次分配SLAB_CHUNK_NODES个连续节点（批量建表时一块容纳全部节点）
+typedef struct SlabChunk {
+    struct SlabChunk *next;  // 下一块
+    size_t cap;              // 块中节点数
+    size_t used;             // 已切分出去的节点数
+    BookNode nodes[];        // 节点存储区
+} SlabChunk;
+
+// ISBN索引：开放寻址（线性探测）哈希表，装载因子不超过1/2
+struct BookIndex {
+    BookNode *head;          // 所属链表的当前头指针
+    IndexSlot *slots;        // 哈希槽
+    size_t capacity;         // 槽位数
+    size_t count;            // 已登记节点数
+
+    // 节点存储：链表节点全部从本索引的slab中分配，随索引整体释放
+    SlabChunk *chunks;       // slab块链表（最新的块在前）
+    BookNode *free_nodes;    // 删除后可复用的节点（借用next字段串成空闲链表）
+    BookNode **nodes;        // 图书编号 -> 节点（已删除的为NULL）
+    size_t node_count;       // 已编号节点数
+    size_t live_count;       // 未删除的节点数（count是已占用的哈希槽数，二者由各自的操作分别维护）
+    size_t node_cap;         // nodes及各列容量
+
+    // 热点数值列（按图书编号连续存放，与节点中的stock/loaned保持同步）
+    int *stock_col;          // 库存量，已删除的为0
+    int *loaned_col;         // 借阅量，已删除的为-1
+    int64_t *order_col;      // 链表位置键：越大越靠前（头插取order_top+1，尾插取order_bottom-1，重排后按新顺序重编）
+    int64_t order_top;       // 已分配的最大位置键
+    int64_t order_bottom;    // 已分配的最小位置键
+
+    // 增量维护的统计量（报告直接读取，无需扫描）
+    size_t stock_gt_cnt;     // 库存 > AGG_STOCK_THRESHOLD 的图书数
+    uint32_t *hot_heap;      // 按借阅量排列的大顶堆（存图书编号）
+    uint32_t *hot_pos;       // 图书编号 -> 在堆中的位置
+    size_t hot_len;          // 堆中元素数
+
+    // 书名/作者三元组倒排索引
+    Posting *grams;          // 三元组哈希表
+    size_t gram_capacity;    // 三元组槽位数（2的幂）
+    size_t gram_count;       // 不同三元组个数
+    int gram_ok;             // 倒排索引是否可用（内存不足时置0，搜索退回遍历）
+    int gram_pending;        // 倒排索引尚未建立（批量建表后推迟到第一次关键词搜索）
+
+    uint64_t generation;     // 修改计数：增删图书、改库存/借阅量、重排时递增
+
+    struct BookIndex *next;  // 全局索引登记表中的下一个
+};
+
+static BookIndex *g_indexes = NULL; // 所有存活索引（通常只有一两个链表）
+
+IsbnKey isbn_pack(const char *isbn) {
+    if (isbn == NULL) return ISBN_KEY_NONE;
+
+    uint64_t value = 0;
+    unsigned len = 0;
+    for (; isbn[len] != '\0'; len++) {
+        if (isbn[len] < '0' || isbn[len] > '9' || len >= ISBN_KEY_MAX_DIGITS) {
+            return ISBN_KEY_NONE; // 含非数字字符或过长：退回字符串路径
+        }
+        value = value * 10 + (uint64_t)(isbn[len] - '0');
+    }
+    if (len == 0) return ISBN_KEY_NONE;
+    // 高位存位数，保证"0012"与"12"得到不同的键
+    return ((uint64_t)len << 57) | value;
+}
+
+void isbn_unpack(IsbnKey key, char *buf, size_t size) {
+    if (buf == NULL || size == 0) return;
+    unsigned len = (unsigned)(key >> 57);
+    uint64_t value = key & ((1ull << 57) - 1);
+    if (key == ISBN_KEY_NONE || len >= size) {
+        buf[0] = '\0';
+        return;
+    }
+    // 从低位往高位写，位数不足时补前导0
+    buf[len] = '\0';
+    for (unsigned i = len; i > 0; i--) {
+        buf[i - 1] = (char)('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// 计算ISBN的哈希值：数字ISBN对紧凑键做乘法散列，其余用FNV-1a
+static size_t hash_isbn(IsbnKey key, const char *isbn) {
+    if (key != ISBN_KEY_NONE) {
+        uint64_t h = key * 0x9E3779B97F4A7C15ull;
+        return (size_t)(h ^ (h >> 32));
+    }
+    size_t h = 2166136261u;
+    while (*isbn) {
+        h ^= (unsigned char)*isbn++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 在索引中查找ISBN，返回所在槽位（命中）或应插入的空槽位
+static size_t index_probe(const BookIndex *idx, IsbnKey key, const char *isbn) {
+    size_t mask = idx->capacity - 1;
+    size_t pos = hash_isbn(key, isbn) & mask;
+    while (idx->slots[pos].node != NULL) {
+        const IndexSlot *slot = &idx->slots[pos];
+        if (key != ISBN_KEY_NONE) {
+            if (slot->key == key) break; // 一次整数比较
+        } else if (slot->key == ISBN_KEY_NONE && strcmp(slot->node->isbn, isbn) == 0) {
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+// 扩容到new_cap个槽位（2的幂）并重新散列，失败返回-1
+static int index_resize(BookIndex *idx, size_t new_cap) {
+    IndexSlot *new_slots = (IndexSlot *)calloc(new_cap, sizeof(IndexSlot));
+    if (new_slots == NULL) return -1;
+
+    IndexSlot *old_slots = idx->slots;
+    size_t old_cap = idx->capacity;
+    idx->slots = new_slots;
+    idx->capacity = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_slots[i].node != NULL) {
+            idx->slots[index_probe(idx, old_slots[i].key, old_slots[i].node->isbn)] = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+// 扩容为原来的两倍，失败返回-1
+static int index_grow(BookIndex *idx) {
+    return index_resize(idx, idx->capacity * 2);
+}
+
+// 在三元组哈希表中查找gram，返回所在槽位（命中）或空槽位
+static size_t gram_probe(const BookIndex *idx, uint32_t gram) {
+    size_t mask = idx->gram_capacity - 1;
+    size_t pos = (size_t)((gram * 2654435761u) ^ (gram >> 13)) & mask;
+    while (idx->grams[pos].gram != 0 && idx->grams[pos].gram != gram) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+// 三元组哈希表扩容，失败返回-1
+static int gram_grow(BookIndex *idx) {
+    size_t new_cap = idx->gram_capacity ? idx->gram_capacity * 2 : INDEX_INIT_CAPACITY;
+    Posting *new_grams = (Posting *)calloc(new_cap, sizeof(Posting));
+    if (new_grams == NULL) return -1;
+
+    Posting *old_grams = idx->grams;
+    size_t old_cap = idx->gram_capacity;
+    idx->grams = new_grams;
+    idx->gram_capacity = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_grams[i].gram != 0) {
+            idx->grams[gram_probe(idx, old_grams[i].gram)] = old_grams[i];
+        }
+    }
+    free(old_grams);
+    return 0;
+}
+
+// 把文本的所有三元组登记到图书编号id下，失败返回-1
+static int gram_add_text(BookIndex *idx, const char *text, uint32_t id) {
+    const unsigned char *p = (const unsigned char *)text;
+    size_t len = strlen(text);
+    for (size_t i = 0; i + GRAM_LEN <= len; i++) {
+        uint32_t gram = (((uint32_t)p[i] << 16) | ((uint32_t)p[i + 1] << 8) | p[i + 2]) + 1;
+
+        if ((idx->gram_count + 1) * 2 > idx->gram_capacity && gram_grow(idx) != 0) {
+            return -1;
+        }
+        Posting *post = &idx->grams[gram_probe(idx, gram)];
+        if (post->gram == 0) {
+            post->gram = gram;
+            idx->gram_count++;
+        }
+        // 同一本书的三元组连续登记，只需与末尾比较即可去重
+        if (post->len > 0 && post->ids[post->len - 1] == id) {
+            continue;
+        }
+        if (post->len == post->cap) {
+            uint32_t new_cap = post->cap ? post->cap * 2 : 4;
+            uint32_t *new_ids = (uint32_t *)realloc(post->ids, new_cap * sizeof(uint32_t));
+            if (new_ids == NULL) return -1;
+            post->ids = new_ids;
+            post->cap = new_cap;
+        }
+        post->ids[post->len++] = id;
+    }
+    return 0;
+}
+
+// 释放三元组倒排索引，之后关键词搜索退回遍历
+static void gram_free(BookIndex *idx) {
+    for (size_t i = 0; i < idx->gram_capacity; i++) {
+        free(idx->grams[i].ids);
+    }
+    free(idx->grams);
+    idx->grams = NULL;
+    idx->gram_capacity = 0;
+    idx->gram_count = 0;
+    idx->gram_ok = 0;
+}
+
+// 登记编号为id的图书的书名、作者三元组
+static void gram_insert(BookIndex *idx, const BookNode *node, uint32_t id) {
+    if (!idx->gram_ok || idx->gram_pending) return;
+    if (gram_add_text(idx, node->title, id) != 0 || gram_add_text(idx, node->author, id) != 0) {
+        gram_free(idx);
+    }
+}
+
+// 丢弃已建立的倒排索引，改为推迟到第一次关键词搜索时重建（批量插入前调用）
+static void gram_defer(BookIndex *idx) {
+    if (!idx->gram_ok || idx->gram_pending) return;
+    gram_free(idx);
+    idx->gram_ok = 1;
+    idx->gram_pending = 1;
+}
+
+// 为全部图书建立推迟的倒排索引（编号升序插入，倒排表保持有序）
+static void gram_build(BookIndex *idx) {
+    idx->gram_pending = 0;
+    for (size_t id = 0; id < idx->node_count && idx->gram_ok; id++) {
+        if (idx->nodes[id] != NULL) gram_insert(idx, idx->nodes[id], (uint32_t)id);
+    }
+}
+
+// 从slab中取一个节点：优先复用已删除的节点，否则从当前块切分，块用完再申请新块
+static BookNode *slab_alloc(BookIndex *idx) {
+    if (idx->free_nodes != NULL) {
+        BookNode *node = idx->free_nodes;
+        idx->free_nodes = node->next;
+        return node;
+    }
+    if (idx->chunks == NULL || idx->chunks->used == idx->chunks->cap) {
+        SlabChunk *chunk = (SlabChunk *)malloc(sizeof(SlabChunk) + SLAB_CHUNK_NODES * sizeof(BookNode));
+        if (chunk == NULL) return NULL;
+        chunk->cap = SLAB_CHUNK_NODES;
+        chunk->used = 0;
+        chunk->next = idx->chunks;
+        idx->chunks = chunk;
+    }
+    return &idx->chunks->nodes[idx->chunks->used++];
+}
+
+// 把节点放回空闲链表，供后续插入复用
+static void slab_release(BookIndex *idx, BookNode *node) {
+    node->next = idx->free_nodes;
+    idx->free_nodes = node;
+}
+
+// 在升序数组ids[0..len)中二分查找id
+static int ids_contain(const uint32_t *ids, uint32_t len, uint32_t id) {
+    uint32_t lo = 0, hi = len;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (ids[mid] < id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < len && ids[lo] == id;
+}
+
+/*
+ * 用倒排索引求候选集：取关键词的所有三元组，从最短的倒排表出发依次求交集。
+ * 返回候选数（写入*out，调用方free），-1表示关键词过短或索引不可用，需退回遍历。
+ */
+static long gram_candidates(const BookIndex *idx, const char *keyword, uint32_t **out) {
+    *out = NULL;
+    size_t len = strlen(keyword);
+    if (!idx->gram_ok || len < GRAM_LEN) return -1;
+    // 所有书名、作者都短于三元组时哈希表从未分配，长关键词不可能匹配
+    if (idx->gram_capacity == 0 || idx->grams == NULL) return 0;
+
+    const Posting *lists[MAX_QUERY_GRAMS];
+    size_t n = 0;
+    const unsigned char *p = (const unsigned char *)keyword;
+    for (size_t i = 0; i + GRAM_LEN <= len && n < MAX_QUERY_GRAMS; i++) {
+        uint32_t gram = (((uint32_t)p[i] << 16) | ((uint32_t)p[i + 1] << 8) | p[i + 2]) + 1;
+        const Posting *post = &idx->grams[gram_probe(idx, gram)];
+        if (post->gram == 0) return 0; // 有三元组从未出现过，必然无结果
+        lists[n++] = post;
+    }
+
+    // 按倒排表长度升序排列（插入排序，n很小）
+    for (size_t i = 1; i < n; i++) {
+        const Posting *tmp = lists[i];
+        size_t j = i;
+        while (j > 0 && lists[j - 1]->len > tmp->len) {
+            lists[j] = lists[j - 1];
+            j--;
+        }
+        lists[j] = tmp;
+    }
+
+    uint32_t *cand = (uint32_t *)malloc(lists[0]->len * sizeof(uint32_t));
+    if (cand == NULL) return -1;
+    memcpy(cand, lists[0]->ids, lists[0]->len * sizeof(uint32_t));
+    uint32_t cand_len = lists[0]->len;
+
+    for (size_t k = 1; k < n && cand_len > 0; k++) {
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < cand_len; i++) {
+            if (ids_contain(lists[k]->ids, lists[k]->len, cand[i])) {
+                cand[kept++] = cand[i];
+            }
+        }
+        cand_len = kept;
+    }
+    *out = cand;
+    return (long)cand_len;
+}
+
+// 创建空索引并登记到全局登记表，with_grams=0时不建三元组索引
+static BookIndex *index_create(int with_grams) {
+    BookIndex *idx = (BookIndex *)calloc(1, sizeof(BookIndex));
+    if (idx == NULL) return NULL;
+    idx->slots = (IndexSlot *)calloc(INDEX_INIT_CAPACITY, sizeof(IndexSlot));
+    if (idx->slots == NULL) {
+        free(idx);
+        return NULL;
+    }
+    idx->capacity = INDEX_INIT_CAPACITY;
+    idx->gram_ok = with_grams;
+    idx->order_top = -1;
+    idx->order_bottom = 0;
+    idx->next = g_indexes;
+    g_indexes = idx;
+    return idx;
+}
+
+// 从全局登记表中摘除并释放索引，连同slab中的全部节点（按块释放）
+static void index_free(BookIndex *idx) {
+    BookIndex **pp = &g_indexes;
+    while (*pp != NULL && *pp != idx) {
+        pp = &(*pp)->next;
+    }
+    if (*pp != NULL) {
+        *pp = idx->next;
+    }
+    SlabChunk *chunk = idx->chunks;
+    while (chunk != NULL) {
+        SlabChunk *next_chunk = chunk->next;
+        free(chunk);
+        chunk = next_chunk;
+    }
+    gram_free(idx);
+    free(idx->nodes);
+    free(idx->stock_col);
+    free(idx->loaned_col);
+    free(idx->order_col);
+    free(idx->hot_heap);
+    free(idx->hot_pos);
+    free(idx->slots);
+    free(idx);
+}
+
+// 给节点各字段赋值（字符串截断并保证结尾'\0'）
+static void fill_node(BookNode *node, const char *isbn, const char *title, const char *author, int stock, int loaned) {
+    strncpy(node->isbn, isbn, sizeof(node->isbn)-1);
+    node->isbn[sizeof(node->isbn)-1] = '\0';
+    strncpy(node->title, title, sizeof(node->title)-1);
+    node->title[sizeof(node->title)-1] = '\0';
+    strncpy(node->author, author, sizeof(node->author)-1);
+    node->author[sizeof(node->author)-1] = '\0';
+    node->stock = stock;
+    node->loaned = loaned;
+    node->next = NULL;
+}
+
+// 编号a是否比b更热门：借阅量更高，相同时取链表中靠前的（与遍历链表取第一本一致，不随重新加载时的编号变化）
+static int hot_before(const BookIndex *idx, uint32_t a, uint32_t b) {
+    int la = idx->loaned_col[a], lb = idx->loaned_col[b];
+    return la > lb || (la == lb && idx->order_col[a] > idx->order_col[b]);
+}
+
+// 交换堆中两个位置并更新位置表
+static void hot_swap(BookIndex *idx, size_t i, size_t j) {
+    uint32_t t = idx->hot_heap[i];
+    idx->hot_heap[i] = idx->hot_heap[j];
+    idx->hot_heap[j] = t;
+    idx->hot_pos[idx->hot_heap[i]] = (uint32_t)i;
+    idx->hot_pos[idx->hot_heap[j]] = (uint32_t)j;
+}
+
+// 堆中位置i向下调整到正确位置
+static void hot_sift_down(BookIndex *idx, size_t i) {
+    while (1) {
+        size_t best = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < idx->hot_len && hot_before(idx, idx->hot_heap[l], idx->hot_heap[best])) best = l;
+        if (r < idx->hot_len && hot_before(idx, idx->hot_heap[r], idx->hot_heap[best])) best = r;
+        if (best == i) return;
+        hot_swap(idx, i, best);
+        i = best;
+    }
+}
+
+// 堆中位置i的借阅量改变后，向上或向下调整到正确位置
+static void hot_fix(BookIndex *idx, size_t i) {
+    while (i > 0 && hot_before(idx, idx->hot_heap[i], idx->hot_heap[(i - 1) / 2])) {
+        hot_swap(idx, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    hot_sift_down(idx, i);
+}
+
+// 把编号为id的图书从热度堆中移除
+static void hot_remove(BookIndex *idx, uint32_t id) {
+    size_t i = idx->hot_pos[id];
+    idx->hot_len--;
+    if (i != idx->hot_len) {
+        hot_swap(idx, i, idx->hot_len);
+        hot_fix(idx, i);
+    }
+}
+
+// 按编号扩容数组（元素大小elem），成功返回0
+static int grow_id_array(void **arr, size_t new_cap, size_t elem) {
+    void *p = realloc(*arr, new_cap * elem);
+    if (p == NULL) return -1;
+    *arr = p;
+    return 0;
+}
+
+/*
+ * 在索引中新建一个节点：先预留哈希槽和编号空间，再从slab分配并登记。
+ * 任一步内存不足都不会改动索引，返回NULL。节点尚未链入链表，由调用方链接到表头（append=0）或表尾（append=1）。
+ */
+static BookNode *index_new_node(BookIndex *idx, const char *isbn, const char *title, const char *author, int stock, int loaned, int append) {
+    // 装载因子超过1/2时扩容
+    if ((idx->count + 1) * 2 > idx->capacity && index_grow(idx) != 0) {
+        return NULL;
+    }
+    if (idx->node_count == idx->node_cap) {
+        // 各数组全部扩容成功后才更新容量，中途失败时已扩容的数组下次直接复用
+        size_t new_cap = idx->node_cap ? idx->node_cap * 2 : INDEX_INIT_CAPACITY;
+        if (grow_id_array((void **)&idx->nodes, new_cap, sizeof(BookNode *)) != 0 ||
+            grow_id_array((void **)&idx->stock_col, new_cap, sizeof(int)) != 0 ||
+            grow_id_array((void **)&idx->loaned_col, new_cap, sizeof(int)) != 0 ||
+            grow_id_array((void **)&idx->order_col, new_cap, sizeof(int64_t)) != 0 ||
+            grow_id_array((void **)&idx->hot_heap, new_cap, sizeof(uint32_t)) != 0 ||
+            grow_id_array((void **)&idx->hot_pos, new_cap, sizeof(uint32_t)) != 0) {
+            return NULL;
+        }
+        idx->node_cap = new_cap;
+    }
+    BookNode *node = slab_alloc(idx);
+    if (node == NULL) return NULL;
+    fill_node(node, isbn, title, author, stock, loaned);
+
+    // 紧凑键在插入时只计算一次
+    uint32_t id = (uint32_t)idx->node_count;
+    IsbnKey key = isbn_pack(node->isbn);
+    size_t pos = index_probe(idx, key, node->isbn);
+    if (idx->slots[pos].node == NULL) {
+        idx->count++;
+    }
+    idx->slots[pos].key = key;
+    idx->slots[pos].node = node;
+    idx->slots[pos].id = id;
+    idx->nodes[id] = node;
+    idx->stock_col[id] = stock;
+    idx->loaned_col[id] = loaned;
+    idx->order_col[id] = append ? --idx->order_bottom : ++idx->order_top;
+    idx->node_count++;
+    idx->live_count++;
+
+    // 更新统计量
+    idx->stock_gt_cnt += (stock > AGG_STOCK_THRESHOLD);
+    idx->hot_heap[idx->hot_len] = id;
+    idx->hot_pos[id] = (uint32_t)idx->hot_len;
+    hot_fix(idx, idx->hot_len++);
+
+    gram_insert(idx, node, id);
+    return node;
+}
+
+// 从哈希表删除pos处的槽位（向后移位删除，不留墓碑）
+static void index_remove_slot(BookIndex *idx, size_t pos) {
+    size_t mask = idx->capacity - 1;
+    size_t hole = pos;
+    size_t cur = (pos + 1) & mask;
+    while (idx->slots[cur].node != NULL) {
+        const IndexSlot *slot = &idx->slots[cur];
+        size_t home = hash_isbn(slot->key, slot->node->isbn) & mask;
+        // home不在(hole, cur]循环区间内时，该槽可以前移填补空洞
+        if (((cur - home) & mask) >= ((cur - hole) & mask)) {
+            idx->slots[hole] = idx->slots[cur];
+            hole = cur;
+        }
+        cur = (cur + 1) & mask;
+    }
+    idx->slots[hole].node = NULL;
+    idx->slots[hole].key = ISBN_KEY_NONE;
+    idx->count--;
+}
+
+BookIndex *book_index_of(BookNode *head) {
+    if (head == NULL) return NULL;
+    for (BookIndex *idx = g_indexes; idx != NULL; idx = idx->next) {
+        if (idx->head == head) return idx;
+    }
+    return NULL;
+}
+
+BookNode *book_list_push(BookNode **head, const char *isbn, const char *title, const char *author, int stock, int loaned) {
+    if (head == NULL || isbn == NULL || title == NULL || author == NULL) {
+        return NULL;
+    }
+
+    BookIndex *idx = book_index_of(*head);
+    if (idx == NULL && *head != NULL) {
+        // 手工拼接的链表没有索引：单独malloc节点，查询退回遍历
+        BookNode *node = (BookNode *)malloc(sizeof(BookNode));
+        if (node == NULL) return NULL;
+        fill_node(node, isbn, title, author, stock, loaned);
+        node->next = *head;
+        *head = node;
+        return node;
+    }
+
+    int created = 0;
+    if (idx == NULL) {
+        // 新链表：创建索引
+        idx = index_create(1);
+        if (idx == NULL) return NULL;
+        created = 1;
+    }
+
+    BookNode *node = index_new_node(idx, isbn, title, author, stock, loaned, 0);
+    if (node == NULL) {
+        if (created) index_free(idx);
+        return NULL;
+    }
+    node->next = *head;
+    *head = node;
+    idx->head = node;
+    idx->generation++;
+    return node;
+}
+
+int book_list_push_batch(BookNode **head, size_t count, BookFillFn fill, void *ctx, size_t *added) {
+    if (added != NULL) *added = 0;
+    if (head == NULL || fill == NULL) return -1;
+    if (count == 0) return 0;
+
+    BookIndex *idx = book_index_of(*head);
+    if (idx == NULL && *head != NULL) {
+        // 手工拼接的链表没有索引：逐本查重后头插
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            BookNode book;
+            fill(&book, i, ctx);
+            book.isbn[sizeof(book.isbn)-1] = '\0';
+            book.title[sizeof(book.title)-1] = '\0';
+            book.author[sizeof(book.author)-1] = '\0';
+            if (search_by_isbn(*head, book.isbn) != NULL) continue;
+            if (book_list_push(head, book.isbn, book.title, book.author, book.stock, book.loaned) == NULL) break;
+            n++;
+        }
+        if (added != NULL) *added = n;
+        return 0;
+    }
+
+    int created = 0;
+    if (idx == NULL) {
+        idx = index_create(1);
+        if (idx == NULL) return -1;
+        created = 1;
+    }
+    if (idx->node_count + count > UINT32_MAX / 2) {
+        if (created) index_free(idx);
+        return -1;
+    }
+
+    // 一次性预留哈希表、编号数组和节点，之后的插入不再扩容
+    size_t total = idx->node_count + count;
+    size_t cap = idx->capacity;
+    while (cap < (idx->count + count) * 2) cap *= 2;
+    SlabChunk *chunk = NULL;
+    int ok = (cap == idx->capacity || index_resize(idx, cap) == 0);
+    if (ok && total > idx->node_cap) {
+        ok = grow_id_array((void **)&idx->nodes, total, sizeof(BookNode *)) == 0 &&
+             grow_id_array((void **)&idx->stock_col, total, sizeof(int)) == 0 &&
+             grow_id_array((void **)&idx->loaned_col, total, sizeof(int)) == 0 &&
+             grow_id_array((void **)&idx->order_col, total, sizeof(int64_t)) == 0 &&
+             grow_id_array((void **)&idx->hot_heap, total, sizeof(uint32_t)) == 0 &&
+             grow_id_array((void **)&idx->hot_pos, total, sizeof(uint32_t)) == 0;
+        if (ok) idx->node_cap = total;
+    }
+    if (ok) chunk = (SlabChunk *)malloc(sizeof(SlabChunk) + count * sizeof(BookNode));
+    if (chunk == NULL) {
+        if (created) index_free(idx);
+        return -1;
+    }
+    chunk->cap = chunk->used = count;
+    chunk->next = idx->chunks;
+    idx->chunks = chunk;
+    gram_defer(idx); // 三元组索引推迟到第一次关键词搜索
+
+    // 查重与登记合为一遍哈希探测：命中已有图书或本批中先出现的同ISBN图书则跳过
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        BookNode *node = &chunk->nodes[i];
+        fill(node, i, ctx);
+        node->isbn[sizeof(node->isbn)-1] = '\0';
+        node->title[sizeof(node->title)-1] = '\0';
+        node->author[sizeof(node->author)-1] = '\0';
+
+        IsbnKey key = isbn_pack(node->isbn);
+        size_t pos = index_probe(idx, key, node->isbn);
+        if (idx->slots[pos].node != NULL) {
+            slab_release(idx, node); // 重复ISBN：节点留给以后的插入复用
+            continue;
+        }
+        uint32_t id = (uint32_t)idx->node_count++;
+        idx->slots[pos].key = key;
+        idx->slots[pos].node = node;
+        idx->slots[pos].id = id;
+        idx->count++;
+        idx->nodes[id] = node;
+        idx->stock_col[id] = node->stock;
+        idx->loaned_col[id] = node->loaned;
+        idx->order_col[id] = ++idx->order_top;
+        idx->live_count++;
+        idx->stock_gt_cnt += (node->stock > AGG_STOCK_THRESHOLD);
+        idx->hot_heap[idx->hot_len] = id;
+        idx->hot_pos[id] = (uint32_t)idx->hot_len++;
+        node->next = *head;
+        *head = node;
+        n++;
+    }
+
+    if (n == 0 && created) {
+        index_free(idx);
+        return 0;
+    }
+    // 热度堆整体重建一次，O(n)
+    for (size_t i = idx->hot_len / 2; i-- > 0;) hot_sift_down(idx, i);
+    idx->head = *head;
+    if (n > 0) idx->generation++;
+    if (added != NULL) *added = n;
+    return 0;
+}
+
+size_t book_isbn_home(IsbnKey key, const char *isbn, size_t capacity) {
+    return hash_isbn(key, isbn) & (capacity - 1);
+}
+
+// 采用预建的ISBN哈希表：每个非空槽的编号和紧凑键都要与节点一致，全部图书恰好各占一槽，成功返回0
+static int index_adopt_slots(BookIndex *idx, const BookIsbnSlot *slots) {
+    size_t used = 0;
+    for (size_t pos = 0; pos < idx->capacity; pos++) {
+        if (slots[pos].id1 == 0) continue;
+        uint32_t id = slots[pos].id1 - 1;
+        if (id >= idx->node_count || idx->slots[pos].node != NULL ||
+            slots[pos].key != isbn_pack(idx->nodes[id]->isbn)) {
+            return -1;
+        }
+        idx->slots[pos].key = slots[pos].key;
+        idx->slots[pos].node = idx->nodes[id];
+        idx->slots[pos].id = id;
+        used++;
+    }
+    idx->count = used;
+    if (used != idx->node_count) return -1;
+    // 每个槽都必须是按散列和线性探测能找到的位置：放错位置的槽查不到，重复的ISBN会先命中前一个
+    for (size_t pos = 0; pos < idx->capacity; pos++) {
+        const IndexSlot *slot = &idx->slots[pos];
+        if (slot->node != NULL && index_probe(idx, slot->key, slot->node->isbn) != pos) return -1;
+    }
+    return 0;
+}
+
+BookNode *book_list_build(size_t count, BookFillFn fill, void *ctx, const BookIsbnSlot *slots, size_t capacity) {
+    if (count == 0 || count > UINT32_MAX / 2 || fill == NULL) return NULL;
+    BookIndex *idx = index_create(1);
+    if (idx == NULL) return NULL;
+    idx->gram_pending = 1; // 三元组索引推迟到第一次关键词搜索
+
+    // 预建哈希表的容量必须是2的幂且装载因子不超过1/2，否则自己散列
+    if (slots == NULL || capacity < count * 2 || (capacity & (capacity - 1)) != 0) {
+        slots = NULL;
+        capacity = INDEX_INIT_CAPACITY;
+        while (capacity < count * 2) capacity *= 2;
+    }
+    free(idx->slots);
+    idx->slots = (IndexSlot *)calloc(capacity, sizeof(IndexSlot));
+    idx->capacity = capacity;
+    idx->chunks = (SlabChunk *)malloc(sizeof(SlabChunk) + count * sizeof(BookNode));
+    if (idx->chunks != NULL) idx->chunks->next = NULL;
+    idx->nodes = (BookNode **)malloc(count * sizeof(BookNode *));
+    idx->stock_col = (int *)malloc(count * sizeof(int));
+    idx->loaned_col = (int *)malloc(count * sizeof(int));
+    idx->order_col = (int64_t *)malloc(count * sizeof(int64_t));
+    idx->hot_heap = (uint32_t *)malloc(count * sizeof(uint32_t));
+    idx->hot_pos = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (idx->slots == NULL || idx->chunks == NULL || idx->nodes == NULL || idx->stock_col == NULL ||
+        idx->loaned_col == NULL || idx->order_col == NULL || idx->hot_heap == NULL || idx->hot_pos == NULL) {
+        index_free(idx);
+        return NULL;
+    }
+    idx->node_cap = count;
+
+    // 节点一次分配并按顺序串成链表；第i本的编号为count-1-i，与逐本头插时的编号一致
+    SlabChunk *chunk = idx->chunks;
+    chunk->cap = chunk->used = count;
+    for (size_t i = 0; i < count; i++) {
+        BookNode *node = &chunk->nodes[i];
+        fill(node, i, ctx);
+        node->isbn[sizeof(node->isbn)-1] = '\0';
+        node->title[sizeof(node->title)-1] = '\0';
+        node->author[sizeof(node->author)-1] = '\0';
+        node->next = (i + 1 < count) ? &chunk->nodes[i + 1] : NULL;
+
+        uint32_t id = (uint32_t)(count - 1 - i);
+        idx->nodes[id] = node;
+        idx->stock_col[id] = node->stock;
+        idx->loaned_col[id] = node->loaned;
+        idx->order_col[id] = id; // 链表顺序即编号倒序
+        idx->stock_gt_cnt += (node->stock > AGG_STOCK_THRESHOLD);
+    }
+    idx->node_count = count;
+    idx->live_count = count;
+    idx->order_top = (int64_t)count - 1;
+
+    // ISBN索引：优先直接采用预建的哈希表，校验不通过时按编号顺序重新散列；ISBN重复说明数据已损坏，建表失败
+    if (slots == NULL || index_adopt_slots(idx, slots) != 0) {
+        memset(idx->slots, 0, capacity * sizeof(IndexSlot));
+        idx->count = 0;
+        for (uint32_t id = 0; id < count; id++) {
+            BookNode *node = idx->nodes[id];
+            IsbnKey key = isbn_pack(node->isbn);
+            size_t pos = index_probe(idx, key, node->isbn);
+            if (idx->slots[pos].node != NULL) {
+                index_free(idx);
+                return NULL;
+            }
+            idx->count++;
+            idx->slots[pos].key = key;
+            idx->slots[pos].node = node;
+            idx->slots[pos].id = id;
+        }
+    }
+
+    // 热度堆：自底向上建堆，O(n)
+    for (uint32_t id = 0; id < count; id++) {
+        idx->hot_heap[id] = id;
+        idx->hot_pos[id] = id;
+    }
+    idx->hot_len = count;
+    for (size_t i = count / 2; i-- > 0;) hot_sift_down(idx, i);
+
+    idx->head = &chunk->nodes[0];
+    return idx->head;
+}
+
+void book_set_counts(BookNode *head, BookNode *book, int stock, int loaned) {
+    if (book == NULL) return;
+    book->stock = stock;
+    book->loaned = loaned;
+
+    // 同步列存储和统计量
+    BookIndex *idx = book_index_of(head);
+    if (idx != NULL) {
+        const IndexSlot *slot = &idx->slots[index_probe(idx, isbn_pack(book->isbn), book->isbn)];
+        if (slot->node == book) {
+            uint32_t id = slot->id;
+            if (idx->stock_col[id] != stock || idx->loaned_col[id] != loaned) idx->generation++;
+            idx->stock_gt_cnt -= (idx->stock_col[id] > AGG_STOCK_THRESHOLD);
+            idx->stock_gt_cnt += (stock > AGG_STOCK_THRESHOLD);
+            idx->stock_col[id] = stock;
+            if (idx->loaned_col[id] != loaned) {
+                idx->loaned_col[id] = loaned;
+                hot_fix(idx, idx->hot_pos[id]);
+            }
+        }
+    }
+}
+
+int book_aggregates(BookNode *head, BookAggregates *out) {
+    BookIndex *idx = book_index_of(head);
+    if (idx == NULL || out == NULL || idx->hot_len == 0) return -1;
+    out->stock_gt_count = idx->stock_gt_cnt;
+    out->hottest = idx->nodes[idx->hot_heap[0]];
+    return 0;
+}
+
+int book_columns(BookNode *head, BookColumns *out) {
+    BookIndex *idx = book_index_of(head);
+    if (idx == NULL || out == NULL) return -1;
+    out->count = idx->node_count;
+    out->live = idx->live_count;
+    out->nodes = idx->nodes;
+    out->stock = idx->stock_col;
+    out->loaned = idx->loaned_col;
+    out->order = idx->order_col;
+    return 0;
+}
+
+void book_index_rehead(BookNode *old_head, BookNode *new_head) {
+    BookIndex *idx = book_index_of(old_head);
+    if (idx != NULL) {
+        idx->head = new_head;
+        idx->generation++;
+        // 按新的链表顺序重编位置键：表头为0，依次递减
+        int64_t order = 0;
+        for (BookNode *node = new_head; node != NULL; node = node->next) {
+            const IndexSlot *slot = &idx->slots[index_probe(idx, isbn_pack(node->isbn), node->isbn)];
+            if (slot->node == node) idx->order_col[slot->id] = order--;
+        }
+        idx->order_top = 0;
+        idx->order_bottom = order + 1;
+        // 热度堆中借阅量相同的图书按位置键比较，位置键变了要重新建堆
+        for (size_t i = idx->hot_len / 2; i-- > 0;) hot_sift_down(idx, i);
+    }
+}
+
+void book_index_prepare(BookNode *head) {
+    BookIndex *idx = book_index_of(head);
+    if (idx != NULL && idx->gram_pending) gram_build(idx);
+}
+
+uint64_t book_list_generation(BookNode *head) {
+    BookIndex *idx = book_index_of(head);
+    return idx != NULL ? idx->generation : 0;
+}
+
 // 添加新书到链表（头插法）
 int add_book(BookNode **head, const char *isbn, const char *title, const char *author, int stock) {
     // 1. 检查参数非空
@@ -23,7 +878,28 @@ BookNode *search_by_isbn(BookNode *head, const char *isbn) {
     if (head == NULL || isbn == NULL) {
         return NULL;
     }
+    return search_by_isbn_key(head, isbn_pack(isbn), isbn);
+}
+
+// 通过预先计算好的紧凑键查找图书
+BookNode *search_by_isbn_key(BookNode *head, IsbnKey key, const char *isbn) {
+    if (head == NULL || (isbn == NULL && key == ISBN_KEY_NONE)) {
+        return NULL;
+    }
+    // 只给了紧凑键：还原字符串供无索引链表比较
+    char unpacked[20];
+    if (isbn == NULL) {
+        isbn_unpack(key, unpacked, sizeof(unpacked));
+        isbn = unpacked;
+    }
 
+    // 有索引时O(1)查找
+    BookIndex *idx = book_index_of(head);
+    if (idx != NULL) {
+        return idx->slots[index_probe(idx, key, isbn)].node;
+    }
+
+    // 无索引的链表：逐个比较
     BookNode *current = head;
     while (current != NULL) {
         if (strcmp(current->isbn, isbn) == 0) {
@@ -34,25 +910,146 @@ BookNode *search_by_isbn(BookNode *head, const char *isbn) {
     return NULL; // 未找到
 }
 
-// 按关键词（书名/作者）模糊搜索
-BookNode *search_by_keyword(BookNode *head, const char *keyword) {
-    if (head == NULL || keyword == NULL || strlen(keyword) == 0) {
-        return NULL;
+// 倒排索引命中的图书及其链表位置键
+typedef struct {
+    int64_t order;
+    BookNode *node;
+} SearchHit;
+
+// qsort比较：位置键大的（靠近表头的）在前
+static int hit_before(const void *a, const void *b) {
+    int64_t x = ((const SearchHit *)a)->order;
+    int64_t y = ((const SearchHit *)b)->order;
+    return (x < y) - (x > y);
+}
+
+// 按关键词（书名/作者）模糊搜索，按链表顺序逐个回调匹配的图书（不复制结果节点）
+size_t search_by_keyword_each(BookNode *head, const char *keyword, BookVisitor visit, void *ctx) {
+    if (head == NULL || keyword == NULL || keyword[0] == '\0' || visit == NULL) {
+        return 0;
     }
 
-    BookNode *result_head = NULL; // 定义结果链表头指针
-    BookNode *current = head;
+    size_t matched = 0;
 
-    while (current != NULL) {
+    // 有倒排索引时只校验候选图书，再按链表位置键排成链表顺序回调
+    BookIndex *idx = book_index_of(head);
+    if (idx != NULL) {
+        if (idx->gram_pending) gram_build(idx);
+        uint32_t *cand = NULL;
+        long cand_len = gram_candidates(idx, keyword, &cand);
+        SearchHit *hits = (cand_len >= 0) ? (SearchHit *)malloc((size_t)(cand_len > 0 ? cand_len : 1) * sizeof(SearchHit)) : NULL;
+        if (hits != NULL) {
+            for (long i = 0; i < cand_len; i++) {
+                BookNode *node = idx->nodes[cand[i]];
+                if (node == NULL) continue; // 已删除
+                if (strstr(node->title, keyword) != NULL || strstr(node->author, keyword) != NULL) {
+                    hits[matched].order = idx->order_col[cand[i]];
+                    hits[matched].node = node;
+                    matched++;
+                }
+            }
+            qsort(hits, matched, sizeof(SearchHit), hit_before);
+            for (size_t i = 0; i < matched; i++) {
+                visit(hits[i].node, ctx);
+            }
+            free(hits);
+            free(cand);
+            return matched;
+        }
+        free(cand); // 关键词过短、索引不可用或内存不足
+    }
+
+    // 无索引或关键词过短：按链表顺序遍历
+    for (BookNode *current = head; current != NULL; current = current->next) {
         // 匹配书名或作者包含关键词
         if (strstr(current->title, keyword) != NULL || strstr(current->author, keyword) != NULL) {
-            // 将匹配的图书添加到结果链表（调用logic里的add_book1函数）
-            add_book1(&result_head, current->isbn, current->title, current->author, current->stock, current->stock);
+            visit(current, ctx);
+            matched++;
         }
-        current = current->next;
     }
+    return matched;
+}
+
+// search_by_keyword的回调：把匹配图书复制到结果链表尾部
+typedef struct {
+    BookIndex *idx; // 结果链表的索引（节点从其slab分配）
+    BookNode *head; // 结果链表头
+    BookNode *tail; // 结果链表尾
+} CopyResult;
 
-    return result_head; 
+static void copy_visit(BookNode *book, void *ctx) {
+    CopyResult *res = (CopyResult *)ctx;
+    if (res->idx == NULL) {
+        // 结果链表只需要ISBN索引和slab，不建三元组索引
+        res->idx = index_create(0);
+        if (res->idx == NULL) return;
+    }
+    BookNode *copy = index_new_node(res->idx, book->isbn, book->title, book->author, book->stock, book->loaned, 1);
+    if (copy == NULL) return;
+    if (res->tail != NULL) {
+        res->tail->next = copy;
+    } else {
+        res->head = copy;
+        res->idx->head = copy;
+    }
+    res->tail = copy;
+}
+
+// 按关键词（书名/作者）模糊搜索，返回匹配结果的副本链表
+BookNode *search_by_keyword(BookNode *head, const char *keyword) {
+    CopyResult res = {NULL, NULL, NULL};
+    search_by_keyword_each(head, keyword, copy_visit, &res);
+    if (res.head == NULL && res.idx != NULL) {
+        index_free(res.idx); // 一个结果都没复制成功
+    }
+    return res.head;
+}
+
+// 按ISBN删除图书，节点放回slab空闲链表
+int delete_book(BookNode **head, const char *isbn) {
+    if (head == NULL || isbn == NULL) {
+        return -2; // 参数非法
+    }
+    BookNode *target = search_by_isbn(*head, isbn);
+    if (target == NULL) {
+        return -1; // 未找到
+    }
+
+    // 1. 从链表中摘除
+    BookIndex *idx = book_index_of(*head);
+    if (*head == target) {
+        *head = target->next;
+        if (idx != NULL) idx->head = *head;
+    } else {
+        BookNode *prev = *head;
+        while (prev->next != target) {
+            prev = prev->next;
+        }
+        prev->next = target->next;
+    }
+
+    if (idx == NULL) {
+        free(target); // 无索引链表的节点是单独malloc的
+        return 0;
+    }
+    if (*head == NULL) {
+        index_free(idx); // 链表已空，整个索引连同slab一起释放
+        return 0;
+    }
+
+    // 2. 从ISBN索引和编号表中移除，节点回收复用
+    size_t pos = index_probe(idx, isbn_pack(target->isbn), target->isbn);
+    uint32_t id = idx->slots[pos].id;
+    idx->stock_gt_cnt -= (idx->stock_col[id] > AGG_STOCK_THRESHOLD);
+    hot_remove(idx, id);
+    idx->nodes[id] = NULL;
+    idx->live_count--;
+    idx->stock_col[id] = 0;
+    idx->loaned_col[id] = -1;
+    index_remove_slot(idx, pos);
+    slab_release(idx, target);
+    idx->generation++;
+    return 0;
 }
 
 //销毁整个链表，释放内存
@@ -61,6 +1058,14 @@ void destroy_list(BookNode **head) {
         return;
     }
 
+    // 有索引的链表：节点都在slab中，按块整体释放
+    BookIndex *idx = book_index_of(*head);
+    if (idx != NULL) {
+        index_free(idx);
+        *head = NULL;
+        return;
+    }
+
     BookNode *current = *head;
     BookNode *next_node = NULL;
 
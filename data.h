@@ -1,6 +1,9 @@
 #ifndef LIBRARY_DATA_H
 #define LIBRARY_DATA_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * @brief 图书节点结构体
  *
@@ -15,6 +18,44 @@ typedef struct Book {
     struct Book *next; // 指向下一节点
 } BookNode;
 
+/**
+ * @brief 紧凑ISBN键
+ *
+ * 纯数字ISBN（ISBN-13等，至多17位）打包为64位整数：高位存位数，低位存数值，
+ * 相等比较与哈希都只需一次整数运算。含非数字字符的旧式ISBN（如末位X）
+ * 得到ISBN_KEY_NONE，退回字符串比较。
+ */
+typedef uint64_t IsbnKey;
+
+#define ISBN_KEY_NONE 0       // 无法打包的ISBN
+#define ISBN_KEY_MAX_DIGITS 17 // 可打包的最大位数
+
+/**
+ * @brief 计算ISBN的紧凑键
+ *
+ * @param isbn ISBN编号
+ * @return IsbnKey 紧凑键，ISBN_KEY_NONE=非纯数字或过长
+ */
+IsbnKey isbn_pack(const char *isbn);
+
+/**
+ * @brief 把紧凑键还原为ISBN字符串
+ *
+ * @param key isbn_pack的结果
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小（键为ISBN_KEY_NONE或空间不足时输出空串）
+ */
+void isbn_unpack(IsbnKey key, char *buf, size_t size);
+
+/**
+ * @brief ISBN哈希索引（链表旁路结构）
+ *
+ * BookNode结构不可修改，因此索引单独存放：每个由add_book1构建的链表
+ * 对应一个BookIndex，通过链表当前头指针定位。手工拼接的链表没有索引，
+ * 相关查询自动退回到遍历链表。
+ */
+typedef struct BookIndex BookIndex;
+
 /**
  * @brief 添加新书到链表
  *
@@ -36,15 +77,225 @@ int add_book(BookNode **head, const char *isbn, const char *title, const char *a
  */
 BookNode *search_by_isbn(BookNode *head, const char *isbn);
 
+/**
+ * @brief 通过预先计算的紧凑键精确查找图书（批量查询时避免重复打包）
+ *
+ * @param head 链表头指针
+ * @param key isbn_pack(isbn)的结果
+ * @param isbn ISBN编号（无索引或键为ISBN_KEY_NONE时用于字符串比较；键有效时可为NULL）
+ * @return BookNode* 找到的节点指针，NULL=未找到
+ */
+BookNode *search_by_isbn_key(BookNode *head, IsbnKey key, const char *isbn);
+
+/**
+ * @brief 搜索结果回调
+ *
+ * @param book 目录中匹配的图书（指向原链表节点，不可释放）
+ * @param ctx 调用方传入的上下文
+ */
+typedef void (*BookVisitor)(BookNode *book, void *ctx);
+
+/**
+ * @brief 按关键词（书名/作者）模糊搜索，对每个匹配结果调用visit
+ *
+ * 不复制节点、不分配结果链表。无论关键词长短、是否走三元组索引，
+ * 都按当前链表顺序回调（排序后即为排序后的顺序）。
+ *
+ * @param head 链表头指针
+ * @param keyword 搜索关键词
+ * @param visit 回调函数
+ * @param ctx 传给回调的上下文
+ * @return size_t 匹配数量
+ */
+size_t search_by_keyword_each(BookNode *head, const char *keyword, BookVisitor visit, void *ctx);
+
 /**
  * @brief 按关键词（书名/作者）模糊搜索
  *
+ * 兼容接口：把匹配结果复制成新链表，调用方需destroy_list释放。
+ * 只需遍历结果时请使用search_by_keyword_each。
+ *
  * @param head 链表头指针
  * @param keyword 搜索关键词
  * @return BookNode* 匹配结果链表的头指针
  */
 BookNode *search_by_keyword(BookNode *head, const char *keyword);
 
+/**
+ * @brief 获取链表对应的ISBN索引
+ *
+ * @param head 链表头指针（必须是当前完整链表的头）
+ * @return BookIndex* 索引指针，NULL=该链表没有索引
+ */
+BookIndex *book_index_of(BookNode *head);
+
+/**
+ * @brief 头插法创建新节点并登记到索引
+ *
+ * 空链表会新建索引；有索引的链表从索引的slab中分配节点（连续成块、
+ * 随destroy_list按块释放、复用delete_book删除的节点）；手工拼接的无索引链表
+ * 单独malloc节点。不做ISBN重复检查，由调用方（add_book1）负责。
+ *
+ * @param head 链表头指针的指针
+ * @param isbn ISBN编号
+ * @param title 书名
+ * @param author 作者
+ * @param stock 库存量
+ * @param loaned 借阅量
+ * @return BookNode* 新节点（已成为链表头），NULL=内存不足
+ */
+BookNode *book_list_push(BookNode **head, const char *isbn, const char *title, const char *author, int stock, int loaned);
+
+/**
+ * @brief 预建的ISBN哈希槽（快照文件中的索引段，按小端布局直接映射）
+ */
+typedef struct {
+    uint64_t key;      // 紧凑ISBN键（isbn_pack的结果）
+    uint32_t id1;      // 图书编号+1，0表示空槽
+    uint32_t reserved; // 保留，写0
+} BookIsbnSlot;
+
+#define BOOK_INDEX_LAYOUT 1 // 哈希槽排布算法版本（散列函数+线性探测），改动散列时递增
+
+/**
+ * @brief 计算ISBN在容量为capacity（2的幂）的哈希表中的起始槽位，供离线预建哈希表
+ *
+ * @param key 紧凑ISBN键
+ * @param isbn ISBN编号
+ * @param capacity 槽位数
+ * @return size_t 起始槽位，冲突时向后线性探测
+ */
+size_t book_isbn_home(IsbnKey key, const char *isbn, size_t capacity);
+
+/**
+ * @brief 批量建表时填写第i本书的回调（只需填isbn/title/author/stock/loaned）
+ */
+typedef void (*BookFillFn)(BookNode *node, size_t i, void *ctx);
+
+/**
+ * @brief 批量建立带索引的链表（用于加载快照）
+ *
+ * 全部节点一次分配，fill填写第i本（链表中第i个，0为表头），第i本的图书编号为count-1-i。
+ * slots不为NULL时直接采用预建的ISBN哈希表（capacity个槽），校验不通过则自行散列；
+ * 三元组索引推迟到第一次关键词搜索时建立。ISBN有重复时视为数据损坏，返回NULL。
+ *
+ * @param count 图书数量
+ * @param fill 填写回调
+ * @param ctx 回调上下文
+ * @param slots 预建的ISBN哈希表，可为NULL
+ * @param capacity slots的槽位数
+ * @return BookNode* 链表头，NULL=内存不足、count为0或ISBN重复
+ */
+BookNode *book_list_build(size_t count, BookFillFn fill, void *ctx, const BookIsbnSlot *slots, size_t capacity);
+
+/**
+ * @brief 批量头插图书（用于批量导入）
+ *
+ * 一次性预留哈希表、编号空间和全部节点，fill依次填写第i本（按i顺序头插，与逐本book_list_push的结果一致）。
+ * 查重与登记合为一遍哈希探测：ISBN已在链表中或本批中已出现的跳过（保留先出现的）。
+ * 三元组索引推迟到第一次关键词搜索时（重新）建立。
+ *
+ * @param head 链表头指针的地址
+ * @param count 待插入的图书数
+ * @param fill 填写回调
+ * @param ctx 回调上下文
+ * @param added 输出实际插入的图书数，可为NULL
+ * @return int 0=成功, -1=参数非法或内存不足（链表不变）
+ */
+int book_list_push_batch(BookNode **head, size_t count, BookFillFn fill, void *ctx, size_t *added);
+
+/**
+ * @brief 修改图书的库存量和借阅量
+ *
+ * 有索引的链表在索引中另存一份按编号连续排列的stock/loaned列，
+ * 修改这两个字段必须经过本函数，以保持列与节点同步。
+ *
+ * @param head 图书所在链表的头指针
+ * @param book 要修改的图书
+ * @param stock 新库存量
+ * @param loaned 新借阅量
+ */
+void book_set_counts(BookNode *head, BookNode *book, int stock, int loaned);
+
+/**
+ * @brief 热点数值列的只读视图（按图书编号连续存放，适合顺序扫描）
+ */
+typedef struct {
+    size_t count;           // 编号总数（含已删除）
+    size_t live;            // 未删除的图书数
+    BookNode *const *nodes; // 编号 -> 节点，已删除的为NULL
+    const int *stock;       // 库存量，已删除的为0
+    const int *loaned;      // 借阅量，已删除的为-1
+    const int64_t *order;   // 链表位置键：越大越靠前，已删除的无意义
+} BookColumns;
+
+/**
+ * @brief 获取链表的数值列视图
+ *
+ * @param head 链表头指针
+ * @param out 输出视图（链表增删后失效）
+ * @return int 0=成功, -1=链表无索引
+ */
+int book_columns(BookNode *head, BookColumns *out);
+
+#define AGG_STOCK_THRESHOLD 5 // 统计报告中“库存充足”的阈值（库存 > 5）
+
+/**
+ * @brief 增量维护的统计量
+ */
+typedef struct {
+    size_t stock_gt_count; // 库存 > AGG_STOCK_THRESHOLD 的图书数
+    BookNode *hottest;     // 借阅量最高的图书（相同时取链表中靠前的）
+} BookAggregates;
+
+/**
+ * @brief 读取链表的统计量（O(1)，由插入、删除和book_set_counts增量维护）
+ *
+ * @param head 链表头指针
+ * @param out 输出统计量
+ * @return int 0=成功, -1=链表无索引或为空
+ */
+int book_aggregates(BookNode *head, BookAggregates *out);
+
+/**
+ * @brief 链表重新串联（如排序）后更新索引记录的头指针
+ *
+ * 链表串联完成后调用：同时按新的链表顺序重排关键词搜索结果的顺序。
+ *
+ * @param old_head 重排前的链表头
+ * @param new_head 重排后的链表头
+ */
+void book_index_rehead(BookNode *old_head, BookNode *new_head);
+
+/**
+ * @brief 立即建立推迟的索引结构（批量建表/导入后的三元组索引）
+ *
+ * 之后的只读查询（search_by_isbn、search_by_keyword_each、top_k_books、报告）不再修改索引，
+ * 可以在多个线程中并发执行（前提是没有线程同时修改链表）。
+ *
+ * @param head 链表头指针
+ */
+void book_index_prepare(BookNode *head);
+
+/**
+ * @brief 链表的修改计数（增删图书、改库存/借阅量、重排时递增）
+ *
+ * 记下某一时刻的值，之后比较即可知道链表是否被修改过（如退出时决定是否需要保存）。
+ *
+ * @param head 链表头指针
+ * @return uint64_t 修改计数，链表无索引时为0
+ */
+uint64_t book_list_generation(BookNode *head);
+
+/**
+ * @brief 按ISBN删除图书
+ *
+ * @param head 链表头指针的指针
+ * @param isbn ISBN编号
+ * @return int 0=成功, -1=未找到, -2=参数非法
+ */
+int delete_book(BookNode **head, const char *isbn);
+
 /**
  * @brief 销毁整个链表，释放内存
  *
@@ -2,6 +2,7 @@
 #include "data.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 // TODO: 实现图书添加（检查ISBN重复、动态分配内存）
@@ -12,46 +13,33 @@ BookNode *add_book1(BookNode **head, const char *title, const char *author, cons
      * 2. 使用malloc创建节点
      * 3. 返回新链表头
      * -------------------- */
-    // 1. logic层分配内存
-    BookNode *new_node = (BookNode *)malloc(sizeof(BookNode));
-    // 1. 用malloc创建节点
-    if (new_node == NULL) { 
-        // 检查内存分配是否成功
-        printf("错误：内存分配失败，无法创建图书节点！\n");
-        return *head; // 返回当前头指针
-    }
-
-    // 2. 给节点赋值
-    strncpy(new_node->isbn, isbn, sizeof(new_node->isbn)-1);
-    new_node->isbn[sizeof(new_node->isbn)-1] = '\0';
-
-    strncpy(new_node->title, title, sizeof(new_node->title)-1);
-    new_node->title[sizeof(new_node->title)-1] = '\0';
-
-    strncpy(new_node->author, author, sizeof(new_node->author)-1);
-    new_node->author[sizeof(new_node->author)-1] = '\0';
-    new_node->stock = stock;
-    new_node->loaned = loaned;
-
-    // 3. 调用data层检查ISBN是否重复
+    // 1. 调用data层检查ISBN是否重复
     int ret = add_book(head, isbn, title, author, stock);
-    if (ret == 1) {
-        free(new_node);// 释放已分配的内存，避免泄漏
+    if (ret != 0) {
         printf("错误：ISBN %s 已存在！\n", isbn);
-        return *head; 
+        return *head;
     }
 
-    // 4. 手动插入节点到链表
-    new_node->next = *head;
-    *head = new_node;
+    // 2. 由data层从链表的slab中分配节点、赋值、头插并登记索引
+    if (book_list_push(head, isbn, title, author, stock, loaned) == NULL) {
+        // 检查内存分配是否成功
+        printf("错误：内存分配失败，无法创建图书节点！\n");
+        return *head; // 返回当前头指针
+    }
     return *head; // 这里返回*head（BookNode*，匹配函数返回值）
 }
 
+// 排序元素：排序键与节点指针放在一起，比较时不再访问节点
+typedef struct {
+    int key;        // 排序键（stock或loaned）
+    BookNode *node; // 对应节点
+} SortItem;
+
 // TODO: 手写快速排序
 // 通用 partition 函数（合并stock/loan逻辑）
-int partition(BookNode** arr, int low, int high, int sort_type) {
+int partition(SortItem* arr, int low, int high, int sort_type) {
     // 基准值二选一：sort_type：0=按stock升序，1=按loaned降序
-    int pivot = (sort_type == 0) ? arr[high]->stock : arr[high]->loaned;
+    int pivot = arr[high].key;
     int i = low - 1;
 
     for (int j = low; j <= high - 1; j++) {
@@ -59,29 +47,29 @@ int partition(BookNode** arr, int low, int high, int sort_type) {
         int cmp_result;
         if (sort_type == 0) {
             // stock升序：当前值 <= 基准值
-            cmp_result = (arr[j]->stock <= pivot);
+            cmp_result = (arr[j].key <= pivot);
         } else {
             // loaned降序：当前值 >= 基准值
-            cmp_result = (arr[j]->loaned >= pivot);
+            cmp_result = (arr[j].key >= pivot);
         }
 
         if (cmp_result) {
             i++;
-            // 交换节点指针
-            BookNode* temp = arr[i];
+            // 交换排序元素
+            SortItem temp = arr[i];
             arr[i] = arr[j];
             arr[j] = temp;
         }
     }
 
-    // 交换基准节点
-    BookNode* temp = arr[i + 1];
+    // 交换基准元素
+    SortItem temp = arr[i + 1];
     arr[i + 1] = arr[high];
     arr[high] = temp;
     return i + 1;
 }
 
-void _quick_sort_arr(BookNode** arr, int low, int high, int sort_type) {
+void _quick_sort_arr(SortItem* arr, int low, int high, int sort_type) {
     if (low < high) {
         int pi = partition(arr, low, high, sort_type); 
         _quick_sort_arr(arr, low, pi - 1, sort_type);
@@ -89,6 +77,77 @@ void _quick_sort_arr(BookNode** arr, int low, int high, int sort_type) {
     }
 }
 
+// 把链表中的图书连同排序键收集到数组，返回元素个数（*out由调用方free），失败返回-1
+static int collect_sort_items(BookNode* head, int sort_type, SortItem** out) {
+    SortItem* arr = NULL;
+    int count = 0;
+
+    BookColumns cols;
+    if (book_columns(head, &cols) == 0) {
+        // 有列存储：顺序扫描数值列提取排序键，不遍历链表
+        // 按编号倒序收集，只在与链表顺序一致时可用（头插法录入、未重排过），
+        // 否则稳定排序会按录入顺序而不是当前顺序处理相同的键，改为遍历链表
+        arr = (SortItem*)malloc(cols.live * sizeof(SortItem));
+        if (arr == NULL) return -1;
+        const int* keys = (sort_type == 0) ? cols.stock : cols.loaned;
+        int64_t last_order = INT64_MAX;
+        for (size_t id = cols.count; id > 0; id--) {
+            if (cols.nodes[id - 1] == NULL) continue;
+            if (cols.order[id - 1] >= last_order) {
+                free(arr);
+                arr = NULL;
+                count = 0;
+                break;
+            }
+            last_order = cols.order[id - 1];
+            // 数组按存活数分配；编号表中的节点更多说明索引已不一致，不越界写入，改为遍历链表
+            if ((size_t)count >= cols.live) {
+                free(arr);
+                arr = NULL;
+                count = 0;
+                break;
+            }
+            arr[count].key = keys[id - 1];
+            arr[count].node = cols.nodes[id - 1];
+            count++;
+        }
+        // 少收集了节点同样不能用：按数组重新串联会丢掉其余的图书
+        if (arr != NULL && (size_t)count != cols.live) {
+            free(arr);
+            arr = NULL;
+            count = 0;
+        }
+    }
+    if (arr == NULL) {
+        // 1：统计链表节点数量
+        BookNode* cur = head;
+        while (cur != NULL) { count++; cur = cur->next; }
+        // 2：创建数组
+        arr = (SortItem*)malloc(count * sizeof(SortItem));
+        if (arr == NULL) return -1;
+        // 3：把链表节点和排序键塞进数组
+        cur = head;
+        for (int i = 0; i < count; i++) {
+            arr[i].key = (sort_type == 0) ? cur->stock : cur->loaned;
+            arr[i].node = cur;
+            cur = cur->next;
+        }
+    }
+    *out = arr;
+    return count;
+}
+
+// 按数组顺序一次性重新串联链表（同步更新索引记录的头指针）
+static void relink_sorted(BookNode** head, const SortItem* arr, int count) {
+    BookNode* old_head = *head;
+    *head = arr[0].node;
+    BookNode* cur = *head;
+    for (int i = 1; i < count; i++) { cur->next = arr[i].node; cur = cur->next; }
+    
+    cur->next = NULL;
+    book_index_rehead(old_head, *head);
+}
+
 void quick_sort(BookNode** head, int sort_type) {
     /* --------------------
      *       [要求]
@@ -96,77 +155,238 @@ void quick_sort(BookNode** head, int sort_type) {
      * 2. 链表头作为参数
      * -------------------- */
     if (head == NULL || *head == NULL) return;
-    // 1：统计链表节点数量
-    int count = 0;
-    BookNode* cur = *head;
-    while (cur != NULL) { count++; cur = cur->next; }
-    // 2：创建数组
-    BookNode** arr = (BookNode**)malloc(count * sizeof(BookNode*));
-    if (arr == NULL) return;
-    // 3：把链表节点塞进数组
-    cur = *head;
-    for (int i = 0; i < count; i++) { arr[i] = cur; cur = cur->next; }
+    SortItem* arr = NULL;
+    int count = collect_sort_items(*head, sort_type, &arr);
+    if (count <= 0) return;
 
     _quick_sort_arr(arr, 0, count - 1, sort_type);
 
     // 数组转回链表
-    *head = arr[0];
-    cur = *head;
-    for (int i = 1; i < count; i++) { cur->next = arr[i]; cur = cur->next; }
-    
-    cur->next = NULL;
-
+    relink_sorted(head, arr, count);
     free(arr);
 }
 
-// 实现sort_by_stock按库存量升序排序
-void sort_by_stock(BookNode **head) {
-    if (head == NULL || *head == NULL) {
-        printf("错误：链表为空，无法按库存排序！\n");
+// 排序键映射为无符号数：翻转符号位使负数排在前面；降序时再整体取反
+static uint32_t radix_key(int key, int descending) {
+    uint32_t u = (uint32_t)key ^ 0x80000000u;
+    return descending ? ~u : u;
+}
+
+/*
+ * LSD基数排序（稳定，O(n)）：每趟按8位分桶，共4趟。键相同的图书保持排序前的链表顺序，
+ * 因此先按库存、再按借阅量排序后，借阅量相同的图书仍按库存排列。
+ * 先一次扫描统计全部4趟的直方图，所有键在某一位上相同（如库存都小于256时的高位）则跳过该趟。
+ * sort_type：0=按stock升序，1=按loaned降序。临时数组分配失败时退回快速排序。
+ */
+void radix_sort(BookNode** head, int sort_type) {
+    if (head == NULL || *head == NULL) return;
+    SortItem* arr = NULL;
+    int count = collect_sort_items(*head, sort_type, &arr);
+    if (count <= 0) return;
+
+    SortItem* tmp = (SortItem*)malloc(count * sizeof(SortItem));
+    if (tmp == NULL) {
+        _quick_sort_arr(arr, 0, count - 1, sort_type);
+        relink_sorted(head, arr, count);
+        free(arr);
         return;
     }
-    quick_sort(head, 0); // 0=按stock升序
-    printf("已按库存量升序排序完成！\n");
+
+    int descending = (sort_type == 1);
+    size_t hist[4][256] = {{0}};
+    for (int i = 0; i < count; i++) {
+        uint32_t k = radix_key(arr[i].key, descending);
+        hist[0][k & 0xFF]++;
+        hist[1][(k >> 8) & 0xFF]++;
+        hist[2][(k >> 16) & 0xFF]++;
+        hist[3][k >> 24]++;
+    }
+
+    SortItem* src = arr;
+    SortItem* dst = tmp;
+    for (int pass = 0; pass < 4; pass++) {
+        int shift = pass * 8;
+        size_t* h = hist[pass];
+        // 所有键在这一位上相同，分桶不会改变顺序
+        if (h[(radix_key(src[0].key, descending) >> shift) & 0xFF] == (size_t)count) {
+            continue;
+        }
+        // 直方图转为各桶起始位置
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t c = h[b];
+            h[b] = offset;
+            offset += c;
+        }
+        // 按原顺序分发，保证稳定
+        for (int i = 0; i < count; i++) {
+            dst[h[(radix_key(src[i].key, descending) >> shift) & 0xFF]++] = src[i];
+        }
+        SortItem* t = src;
+        src = dst;
+        dst = t;
+    }
+
+    relink_sorted(head, src, count);
+    free(arr);
+    free(tmp);
+}
+
+// 实现sort_by_stock按库存量升序排序
+int sort_by_stock(BookNode **head) {
+    if (head == NULL || *head == NULL) return -1; // 链表为空，无法排序
+    radix_sort(head, 0); // 0=按stock升序
+    return 0;
 }
 
 // 最终实现 sort_by_loan按借阅量降序排序
-void sort_by_loan(BookNode **head) {
-    if (head == NULL || *head == NULL) {
-        printf("错误：链表为空，无法按借阅量排序！\n");
-        return;
+int sort_by_loan(BookNode **head) {
+    if (head == NULL || *head == NULL) return -1; // 链表为空，无法排序
+    radix_sort(head, 1); // 1=按loaned降序
+    return 0;
+}
+
+// Top-K堆元素：除排序键外带上链表位置，键相同时与稳定排序一样取链表中靠前的
+typedef struct {
+    int key;        // 排序键（stock或loaned）
+    int64_t order;  // 链表位置键：越大越靠前
+    BookNode *node; // 对应节点
+} TopItem;
+
+// Top-K比较：a是否比b更靠前（sort_type：0=库存少者靠前，1=借阅多者靠前；键相同时链表中靠前者靠前）
+static int topk_better(const TopItem* a, const TopItem* b, int sort_type) {
+    if (a->key != b->key) return (sort_type == 0) ? (a->key < b->key) : (a->key > b->key);
+    return a->order > b->order;
+}
+
+// 堆顶是当前k个中最靠后的一本；从pos处向下调整
+static void topk_sift_down(TopItem* heap, int size, int pos, int sort_type) {
+    while (1) {
+        int worst = pos;
+        int l = 2 * pos + 1, r = 2 * pos + 2;
+        if (l < size && topk_better(&heap[worst], &heap[l], sort_type)) worst = l;
+        if (r < size && topk_better(&heap[worst], &heap[r], sort_type)) worst = r;
+        if (worst == pos) return;
+        TopItem t = heap[pos];
+        heap[pos] = heap[worst];
+        heap[worst] = t;
+        pos = worst;
+    }
+}
+
+// 从pos处向上调整
+static void topk_sift_up(TopItem* heap, int pos, int sort_type) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!topk_better(&heap[parent], &heap[pos], sort_type)) return;
+        TopItem t = heap[pos];
+        heap[pos] = heap[parent];
+        heap[parent] = t;
+        pos = parent;
     }
-    quick_sort(head, 1); // 1=按loaned降序
-    printf("已按借阅量降序排序完成！\n");
+}
+
+// 把一本书交给大小为k的堆：未满直接入堆，已满且比堆顶更靠前则替换堆顶
+static void topk_offer(TopItem* heap, int* size, int k, const TopItem* item, int sort_type) {
+    if (*size < k) {
+        heap[*size] = *item;
+        topk_sift_up(heap, (*size)++, sort_type);
+    } else if (topk_better(item, &heap[0], sort_type)) {
+        heap[0] = *item;
+        topk_sift_down(heap, k, 0, sort_type);
+    }
+}
+
+// 图书数量：有索引时直接读存活数，否则遍历链表
+size_t count_books(BookNode *head) {
+    BookColumns cols;
+    if (book_columns(head, &cols) == 0) return cols.live;
+    size_t count = 0;
+    for (BookNode* cur = head; cur != NULL; cur = cur->next) count++;
+    return count;
+}
+
+// 单趟扫描求Top-K，不改变链表顺序；与先稳定排序再取前k本的结果相同
+int top_k_books(BookNode *head, int sort_type, int k, BookNode **out) {
+    if (head == NULL || out == NULL || k <= 0) return 0;
+
+    // 堆不超过图书总数
+    size_t books = count_books(head);
+    if ((size_t)k > books) k = (int)books;
+
+    TopItem* heap = (TopItem*)malloc(k * sizeof(TopItem));
+    if (heap == NULL) return 0;
+    int size = 0;
+
+    BookColumns cols;
+    if (book_columns(head, &cols) == 0) {
+        // 有列存储：顺序扫描数值列，链表位置取位置键
+        const int* keys = (sort_type == 0) ? cols.stock : cols.loaned;
+        for (size_t id = cols.count; id > 0; id--) {
+            if (cols.nodes[id - 1] != NULL) {
+                TopItem item = {keys[id - 1], cols.order[id - 1], cols.nodes[id - 1]};
+                topk_offer(heap, &size, k, &item, sort_type);
+            }
+        }
+    } else {
+        int64_t order = 0; // 表头为0，依次递减
+        for (BookNode* cur = head; cur != NULL; cur = cur->next) {
+            TopItem item = {(sort_type == 0) ? cur->stock : cur->loaned, order--, cur};
+            topk_offer(heap, &size, k, &item, sort_type);
+        }
+    }
+
+    // 依次弹出堆顶（最靠后的）从尾部往前填，得到从前到后的顺序
+    int count = size;
+    while (size > 0) {
+        out[size - 1] = heap[0].node;
+        heap[0] = heap[--size];
+        topk_sift_down(heap, size, 0, sort_type);
+    }
+    free(heap);
+    return count;
 }
 
 // 生成统计报告：输出库存>5的图书数量、最热门图书（loaned最高）
 void generate_report(BookNode *head) {
+    generate_report_to(head, stdout);
+}
+
+// 生成统计报告并写到out（服务器模式下写给客户端）
+void generate_report_to(BookNode *head, FILE *out) {
     if (head == NULL) {
-        printf("统计报告：当前无图书数据！\n");
+        fprintf(out, "统计报告：当前无图书数据！\n");
         return;
     }
 
     int stock_gt5_cnt = 0; // 库存>5的图书数量
     BookNode *hottest_book = head; // 最热门图书（默认第一个）
 
-    // 遍历链表统计数据
-    BookNode *cur = head;
-    while (cur != NULL) {
-        // 统计库存>5的图书
-        if (cur->stock > 5) {
-            stock_gt5_cnt++;
-        }
-        // 更新最热门图书（loaned更高则替换）
-        if (cur->loaned > hottest_book->loaned) {
-            hottest_book = cur;
+    BookAggregates agg;
+    if (book_aggregates(head, &agg) == 0) {
+        // 有索引：统计量已增量维护，直接读取
+        stock_gt5_cnt = (int)agg.stock_gt_count;
+        hottest_book = agg.hottest;
+    } else {
+        // 遍历链表统计数据
+        BookNode *cur = head;
+        while (cur != NULL) {
+            // 统计库存>5的图书
+            if (cur->stock > AGG_STOCK_THRESHOLD) {
+                stock_gt5_cnt++;
+            }
+            // 更新最热门图书（loaned更高则替换）
+            if (cur->loaned > hottest_book->loaned) {
+                hottest_book = cur;
+            }
+            cur = cur->next;
         }
-        cur = cur->next;
     }
 
     // 输出报告
-    printf("\n===== 图书统计报告 =====\n");
-    printf("1. 库存>5的图书数量：%d 本\n", stock_gt5_cnt);
-    printf("2. 最热门图书：《%s》\n", hottest_book->title);
-    printf("   作者：%s | 借阅量：%d 次\n", hottest_book->author, hottest_book->loaned);
-    printf("=========================\n");
+    fprintf(out, "\n===== 图书统计报告 =====\n");
+    fprintf(out, "1. 库存>5的图书数量：%d 本\n", stock_gt5_cnt);
+    fprintf(out, "2. 最热门图书：《%s》\n", hottest_book->title);
+    fprintf(out, "   作者：%s | 借阅量：%d 次\n", hottest_book->author, hottest_book->loaned);
+    fprintf(out, "=========================\n");
 }
\ No newline at end of file
@@ -3,20 +3,51 @@
 
 #include "data.h"
 
+#include <stdio.h>
+
 BookNode *add_book1(BookNode **head, const char *title, const char *author, const char *isbn, int stock,int loaned);
 /**
- * @brief 按库存量升序排序（使用快速排序）
+ * @brief 按库存量升序排序（稳定的LSD基数排序，O(n)）
+ *
+ * 库存相同的图书保持排序前的先后顺序（有索引和手工拼接的链表相同）。
+ * 不打印提示信息，由调用方根据返回值回复。
  *
  * @param head 链表头指针的指针
+ * @return int 0=成功, -1=链表为空
  */
-void sort_by_stock(BookNode **head);
+int sort_by_stock(BookNode **head);
 
 /**
- * @brief 按借阅量降序排序
+ * @brief 按借阅量降序排序（稳定的LSD基数排序，O(n)）
+ *
+ * 借阅量相同的图书保持排序前的先后顺序，因此先按库存排序再调用本函数，
+ * 借阅量相同的图书按库存升序排列。不打印提示信息，由调用方根据返回值回复。
  *
  * @param head 链表头指针的指针
+ * @return int 0=成功, -1=链表为空
+ */
+int sort_by_loan(BookNode **head);
+
+/**
+ * @brief 求库存最少或借阅最多的前k本书（大小为k的堆，单趟O(n log k)）
+ *
+ * 不修改链表顺序。键相同时按链表顺序取，结果与稳定排序后的前k本相同。
+ *
+ * @param head 链表头指针
+ * @param sort_type 0=库存最少的k本（升序），1=借阅最多的k本（降序）
+ * @param k 需要的数量（超过图书总数时按总数）
+ * @param out 输出数组，至少min(k, count_books(head))个元素
+ * @return int 实际写入out的数量（图书不足k本时小于k）
  */
-void sort_by_loan(BookNode **head);
+int top_k_books(BookNode *head, int sort_type, int k, BookNode **out);
+
+/**
+ * @brief 图书数量（有索引时O(1)，否则遍历链表）
+ *
+ * @param head 链表头指针
+ * @return size_t 链表中的图书数
+ */
+size_t count_books(BookNode *head);
 
 /**
  * @brief 生成统计报告
@@ -25,4 +56,12 @@ void sort_by_loan(BookNode **head);
  */
 void generate_report(BookNode *head);
 
+/**
+ * @brief 生成统计报告并写到指定的流
+ *
+ * @param head 链表头指针
+ * @param out 输出流（generate_report即写到stdout）
+ */
+void generate_report_to(BookNode *head, FILE *out);
+
 #endif // LIBRARY_LOGIC_H
\ No newline at end of file
@@ -1,72 +1,141 @@
 #include "data.h"
 #include "logic.h"
 #include "store.h"
+#include "server.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
-#define PERSISTENCE_FILE "library_data.json"
+#define PERSISTENCE_FILE "library_data.bin"     // 二进制快照
+#define LEGACY_PERSISTENCE_FILE "library_data.json" // 旧版本的JSON数据文件，首次启动时迁移
 #define MAX_INPUT_LEN 256
 #define MAX_KEYWORD_LEN 100
 #define MAX_FILENAME_LEN 50
+#define BATCH_OUTPUT_BUFFER (256 * 1024) // 批处理模式的stdout缓冲区大小
+
+/**
+ * @brief 命令执行结果（--status模式下每条命令输出一行"<行号> <状态码>"）
+ */
+typedef enum {
+    CMD_OK = 0,        // 成功
+    CMD_USAGE = 1,     // 未知命令或参数格式不对
+    CMD_NOT_FOUND = 2, // 图书不存在或没有结果
+    CMD_REJECTED = 3,  // 不符合业务规则（ISBN重复、库存不足等）
+    CMD_FAILED = 4     // 文件读写或内存分配失败
+} CmdStatus;
+
+/**
+ * @brief 运行模式（命令行参数和stdin是否为终端决定）
+ */
+static struct {
+    int batch;  // 批处理模式：不显示提示符，stdout全缓冲，运行信息写到stderr
+    int status; // 每条命令输出一行紧凑状态码，代替成功/错误提示
+} g_cli;
 
 /**
  * @brief 打印帮助信息
  */
-void print_help() {
-    printf("Library Management System\n");
-    printf("Commands:\n");
-    printf("  add <isbn> <title> <author> <stock>   - 添加一本新书\n");
-    printf("  search <keyword>                      - 按关键词（书名/作者）搜索\n");
-    printf("  isbn <isbn>                           - 按ISBN搜索\n");
-    printf("  loan <isbn> <quantity>                - 记录借阅\n");
-    printf("  sort stock                            - 按库存数量升序排列书籍\n");
-    printf("  sort loan                             - 按借阅次数降序排列书籍\n");
-    printf("  report                                - 生成统计报告\n");
-    printf("  export csv <filename>                 - 将书籍导出为CSV文件\n");
-    printf("  export json <filename>                - 将书籍导出为JSON文件\n");
-    printf("  exit                                  - 退出程序\n");
+void print_help(FILE *out) {
+    fprintf(out, "Library Management System\n");
+    fprintf(out, "Commands:\n");
+    fprintf(out, "  add <isbn> <title> <author> <stock>   - 添加一本新书\n");
+    fprintf(out, "  search <keyword>                      - 按关键词（书名/作者）搜索\n");
+    fprintf(out, "  isbn <isbn>                           - 按ISBN搜索\n");
+    fprintf(out, "  loan <isbn> <quantity>                - 记录借阅\n");
+    fprintf(out, "  sort stock                            - 按库存数量升序排列书籍\n");
+    fprintf(out, "  sort loan                             - 按借阅次数降序排列书籍\n");
+    fprintf(out, "  top loan <k>                          - 列出借阅次数最多的k本书\n");
+    fprintf(out, "  top stock <k>                         - 列出库存最少的k本书\n");
+    fprintf(out, "  report                                - 生成统计报告\n");
+    fprintf(out, "  compact                               - 保存数据并压缩借阅记录文件\n");
+    fprintf(out, "  export csv <filename>                 - 将书籍导出为CSV文件\n");
+    fprintf(out, "  export json <filename> [compact]      - 将书籍导出为JSON文件（compact为紧凑格式）\n");
+    fprintf(out, "  import csv <filename>                 - 从CSV文件批量导入书籍（列同export csv）\n");
+    fprintf(out, "  exit                                  - 退出程序\n");
 }
 
 /**
- * @brief 主命令解析循环
+ * @brief 打印usage信息
  */
-void command_loop(BookNode **head) {// 接收图书链表的头指针（二级指针，用于修改链表）
-    char input[MAX_INPUT_LEN];
-    char cmd[20];
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--batch|--interactive] [--status]\n", prog);
+    fprintf(stderr, "       %s [--socket <path>] [--port <n>] [--workers <n>]\n", prog);
+    fprintf(stderr, "  --batch, -b        批处理模式：不显示提示符，输出全缓冲，结束时报告吞吐量（stdin不是终端时默认开启）\n");
+    fprintf(stderr, "  --interactive, -i  交互模式：即使stdin不是终端也显示提示符\n");
+    fprintf(stderr, "  --status, -s       每条命令输出一行\"<行号> <状态码>\"（0成功 1格式错误 2未找到 3被拒绝 4失败），代替提示信息；隐含--batch\n");
+    fprintf(stderr, "  --socket <path>    服务器模式：在Unix域套接字上接受命令（每条回复以\"= <状态码>\"结束），SIGINT/SIGTERM停止并保存\n");
+    fprintf(stderr, "  --port <n>         服务器模式：在127.0.0.1:<n>上接受命令，可与--socket同时使用（服务器模式下不能export/import）\n");
+    fprintf(stderr, "  --workers <n>      服务器模式的工作线程数（默认按CPU数）\n");
+}
 
-    while (1) {
-        printf("> "); // 显示输入提示符
-        if (!fgets(input, sizeof(input), stdin)) { // 读取用户输入
-            break; // 输入错误或EOF时退出
-        }
+/**
+ * @brief 输出命令的成功/错误提示（--status模式下由状态码代替，不输出）
+ */
+static void reply(FILE *out, const char *fmt, ...) {
+    if (g_cli.status) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+}
 
-        // 移除末尾换行符
-        size_t len = strlen(input);
-        if (len > 0 && input[len - 1] == '\n') {
-            input[len - 1] = '\0';
-        }
+/**
+ * @brief 输出运行信息（加载、保存等）：批处理模式写到stderr，不混入命令输出
+ */
+static void info(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(g_cli.batch ? stderr : stdout, fmt, ap);
+    va_end(ap);
+}
 
-        // 解析命令的第一个单词（比如"add"、"help"）
-        if (sscanf(input, "%19s", cmd) != 1) {
-            continue;// 空输入则忽略
-        }
-        // 处理exit命令
-        if (strcmp(cmd, "exit") == 0) {
-            break;
-        } 
-        // 处理help命令
-        else if (strcmp(cmd, "help") == 0) {
-            print_help();
-        }
-        // 处理add命令（匹配logic.c中的add_book1函数参数顺序）
-        else if (strcmp(cmd, "add") == 0) {
-            // TODO: 解析add命令参数
-            // 用sscanf提取参数，调用add_book
-            char isbn[20], title[100], author[50];
-            int stock;
-            int ret;
-            // 先尝试匹配带引号的标题（格式：add <isbn> "<title>" <author> <stock>）
+/**
+ * @brief search命令的打印上下文
+ */
+typedef struct {
+    const char *keyword; // 搜索关键词
+    int count;           // 已打印的结果数
+    FILE *out;           // 输出流
+} SearchPrinter;
+
+/**
+ * @brief 打印一条搜索结果（search_by_keyword_each的回调）
+ */
+static void print_search_hit(BookNode *book, void *ctx) {
+    SearchPrinter *printer = (SearchPrinter *)ctx;
+    if (printer->count == 0) {
+        fprintf(printer->out, "Search results for '%s':\n", printer->keyword);
+    }
+    printer->count++;
+    fprintf(printer->out, "[%d] ISBN: %s, Title: %s, Author: %s, Stock: %d, Loaned: %d\n",
+            printer->count, book->isbn, book->title, book->author, book->stock, book->loaned);
+}
+
+/**
+ * @brief 执行一条命令
+ *
+ * @param input 整行输入（已去掉换行符）
+ * @param cmd 命令的第一个单词
+ * @param saved_generation 最近一次保存时链表的修改计数（compact保存后更新）
+ * @param out 命令输出写到这里（stdout，服务器模式下为发回客户端的缓冲区）
+ * @return int 执行结果（CmdStatus）
+ */
+static int run_command(BookNode **head, uint64_t *saved_generation, const char *input, const char *cmd, FILE *out) {
+    // 处理help命令
+    if (strcmp(cmd, "help") == 0) {
+        print_help(out);
+    }
+    // 处理add命令（匹配logic.c中的add_book1函数参数顺序）
+    else if (strcmp(cmd, "add") == 0) {
+        // TODO: 解析add命令参数
+        // 用sscanf提取参数，调用add_book
+        char isbn[20], title[100], author[50];
+        int stock;
+        int ret;
+        // 先尝试匹配带引号的标题（格式：add <isbn> "<title>" <author> <stock>）
         ret = sscanf(input, "add %19s \"%99[^\"]\" %49s %d", 
                  isbn, title, author, &stock);
         if (ret != 4) {
@@ -74,171 +143,419 @@ void command_loop(BookNode **head) {// 接收图书链表的头指针（二级
             ret = sscanf(input, "add %19s %99s %49s %d", 
                          isbn, title, author, &stock);
         }
-    
+
         // 检查参数是否完整 + 库存是否合法
         if (ret != 4 || stock <= 0) {
-            printf("Invalid format. Usage: add <isbn> [\"<title>\"] <author> <stock>\n");
-            continue;
+            reply(out, "Invalid format. Usage: add <isbn> [\"<title>\"] <author> <stock>\n");
+            return CMD_USAGE;
         }
-    
+
         // 检查ISBN是否重复
         if (search_by_isbn(*head, isbn)) {
-            printf("Error: ISBN %s already exists\n", isbn);
-            continue;
+            reply(out, "Error: ISBN %s already exists\n", isbn);
+            return CMD_REJECTED;
         }
 
         // 调用logic层的add_book1
         add_book1(head, title, author, isbn, stock, 0);
-        printf("Book added successfully.\n");
-        } 
-        // 处理search命令（模糊搜索）
-        else if (strcmp(cmd, "search") == 0) {
-            // TODO: 解析搜索关键词，调用search_by_keyword
-            char keyword[MAX_KEYWORD_LEN];
-            if (sscanf(input, "search %99[^\n]", keyword) != 1) {
-                printf("Invalid format. Usage: search <keyword>\n");
-                continue;
-            }
-            BookNode *results = search_by_keyword(*head, keyword);
-            if (results) {
-                printf("Search results for '%s':\n", keyword);
-                BookNode *curr = results;
-                int count = 0;
-                while (curr) {
-                    count++;
-                    printf("[%d] ISBN: %s, Title: %s, Author: %s, Stock: %d, Loaned: %d\n",
-                           count, curr->isbn, curr->title, curr->author, curr->stock, curr->loaned);
-                    curr = curr->next;
-                }
-                destroy_list(&results); // 释放结果链表
-            } else {
-                printf("No books found matching '%s'\n", keyword);
-            }
+        reply(out, "Book added successfully.\n");
+    } 
+    // 处理search命令（模糊搜索）
+    else if (strcmp(cmd, "search") == 0) {
+        // TODO: 解析搜索关键词，调用search_by_keyword
+        char keyword[MAX_KEYWORD_LEN];
+        if (sscanf(input, "search %99[^\n]", keyword) != 1) {
+            reply(out, "Invalid format. Usage: search <keyword>\n");
+            return CMD_USAGE;
+        }
+        // 直接遍历目录中的匹配图书，不复制结果链表
+        SearchPrinter printer = {keyword, 0, out};
+        if (search_by_keyword_each(*head, keyword, print_search_hit, &printer) == 0) {
+            reply(out, "No books found matching '%s'\n", keyword);
+            return CMD_NOT_FOUND;
+        }
 
-        } 
-        // 处理isbn查询命令（精确搜索）
-        else if (strcmp(cmd, "isbn") == 0) {
-            // TODO: 解析ISBN，调用search_by_isbn
-            char isbn[20];
-            if (sscanf(input, "isbn %19s", isbn) != 1) {
-                printf("Invalid format. Usage: isbn <isbn>\n");
-                continue;
-            }
-            // 调用data.c的search_by_isbn
-            BookNode *book = search_by_isbn(*head, isbn);
-            if (book) {
-                printf("Found book:\n");
-                printf("ISBN: %s\nTitle: %s\nAuthor: %s\nStock: %d\nLoaned: %d\n",
-                       book->isbn, book->title, book->author, book->stock, book->loaned);
-            } else {
-                printf("No book found with ISBN: %s\n", isbn);
-            }
-        } 
-        // 处理loan命令
-        else if (strcmp(cmd, "loan") == 0) {
-            // TODO: 解析loan命令，调用log_loan
-            char isbn[20];
-            int quantity;
-            if (sscanf(input, "loan %19s %d", isbn, &quantity) != 2) {
-                printf("Invalid format. Usage: loan <isbn> <quantity>\n");
-                continue;
-            }
-            if (quantity <= 0) {
-                printf("Quantity must be positive.\n");
-                continue;
-            }
-            BookNode *book = search_by_isbn(*head, isbn);
-            if (!book) {
-                printf("Book with ISBN %s not found.\n", isbn);
-                continue;
-            }
-            if (book->stock < quantity) {
-                printf("Insufficient stock. Available: %d\n", book->stock);
-                continue;
-            }
-            // 调用store层的log_loan记录借阅
-            log_loan(isbn, quantity);
-            book->stock -= quantity;
-            book->loaned += quantity;
-            printf("Loan recorded. New stock: %d, Total loaned: %d\n",
-                   book->stock, book->loaned); 
-        } 
-
-        // 处理sort命令
-        else if (strcmp(cmd, "sort") == 0) {
-            // TODO: 解析排序类型
-            char sort_type[10];
-            if (sscanf(input, "sort %9s", sort_type) != 1) {
-                printf("Invalid format. Usage: sort <stock|loan>\n");
-                continue;
-            }
-            if (strcmp(sort_type, "stock") == 0) {
-                sort_by_stock(head); // 调用logic.c的按库存排序
-            } else if (strcmp(sort_type, "loan") == 0) {
-                sort_by_loan(head); // 调用logic.c的按借阅量排序
-            } else {
-                printf("Invalid sort type. Use 'stock' or 'loan'.\n");
-            }
-        } 
-
-        // 处理report命令
-        else if (strcmp(cmd, "report") == 0) {
-            generate_report(*head);//调用logic.c的报告生成函数
-        } 
-        // 处理export命令
-        else if (strncmp(cmd, "export", 6) == 0) {
-            // TODO: 解析导出命令
-            char format[5], filename[MAX_FILENAME_LEN];
-            if (sscanf(input, "export %4s %49s", format, filename) != 2) {
-                printf("Invalid format. Usage: export <csv|json> <filename>\n");
-                continue;
-            }
-            if (strcmp(format, "csv") == 0) {
-                export_to_csv(filename, *head);
-                printf("Data exported to %s\n", filename);
-            } else if (strcmp(format, "json") == 0) {
-                export_to_json(filename, *head);
-                printf("Data exported to %s\n", filename);
+    } 
+    // 处理isbn查询命令（精确搜索）
+    else if (strcmp(cmd, "isbn") == 0) {
+        // TODO: 解析ISBN，调用search_by_isbn
+        char isbn[20];
+        if (sscanf(input, "isbn %19s", isbn) != 1) {
+            reply(out, "Invalid format. Usage: isbn <isbn>\n");
+            return CMD_USAGE;
+        }
+        // 调用data.c的search_by_isbn
+        BookNode *book = search_by_isbn(*head, isbn);
+        if (book) {
+            fprintf(out, "Found book:\n");
+            fprintf(out, "ISBN: %s\nTitle: %s\nAuthor: %s\nStock: %d\nLoaned: %d\n",
+                    book->isbn, book->title, book->author, book->stock, book->loaned);
+        } else {
+            reply(out, "No book found with ISBN: %s\n", isbn);
+            return CMD_NOT_FOUND;
+        }
+    } 
+    // 处理loan命令
+    else if (strcmp(cmd, "loan") == 0) {
+        // TODO: 解析loan命令，调用log_loan
+        char isbn[20];
+        int quantity;
+        if (sscanf(input, "loan %19s %d", isbn, &quantity) != 2) {
+            reply(out, "Invalid format. Usage: loan <isbn> <quantity>\n");
+            return CMD_USAGE;
+        }
+        if (quantity <= 0) {
+            reply(out, "Quantity must be positive.\n");
+            return CMD_USAGE;
+        }
+        BookNode *book = search_by_isbn(*head, isbn);
+        if (!book) {
+            reply(out, "Book with ISBN %s not found.\n", isbn);
+            return CMD_NOT_FOUND;
+        }
+        if (book->stock < quantity) {
+            reply(out, "Insufficient stock. Available: %d\n", book->stock);
+            return CMD_REJECTED;
+        }
+        // 调用store层的log_loan记录借阅：记不下来就不改库存，以免重启后借阅丢失
+        if (log_loan(isbn, quantity) != 0) {
+            reply(out, "Error: failed to record the loan.\n");
+            return CMD_FAILED;
+        }
+        book_set_counts(*head, book, book->stock - quantity, book->loaned + quantity);
+        reply(out, "Loan recorded. New stock: %d, Total loaned: %d\n",
+               book->stock, book->loaned); 
+    } 
+
+    // 处理sort命令
+    else if (strcmp(cmd, "sort") == 0) {
+        // TODO: 解析排序类型
+        char sort_type[10];
+        if (sscanf(input, "sort %9s", sort_type) != 1) {
+            reply(out, "Invalid format. Usage: sort <stock|loan>\n");
+            return CMD_USAGE;
+        }
+        int sorted;
+        const char *done;
+        if (strcmp(sort_type, "stock") == 0) {
+            sorted = sort_by_stock(head); // 调用logic.c的按库存排序
+            done = "已按库存量升序排序完成！";
+        } else if (strcmp(sort_type, "loan") == 0) {
+            sorted = sort_by_loan(head); // 调用logic.c的按借阅量排序
+            done = "已按借阅量降序排序完成！";
+        } else {
+            reply(out, "Invalid sort type. Use 'stock' or 'loan'.\n");
+            return CMD_USAGE;
+        }
+        if (sorted != 0) {
+            reply(out, "No books in the library.\n");
+            return CMD_NOT_FOUND;
+        }
+        reply(out, "%s\n", done);
+    } 
+
+    // 处理top命令（不改变链表顺序）
+    else if (strcmp(cmd, "top") == 0) {
+        char top_type[10];
+        int k;
+        if (sscanf(input, "top %9s %d", top_type, &k) != 2 || k <= 0) {
+            reply(out, "Invalid format. Usage: top <loan|stock> <k>\n");
+            return CMD_USAGE;
+        }
+        int sort_type;
+        if (strcmp(top_type, "stock") == 0) {
+            sort_type = 0;
+        } else if (strcmp(top_type, "loan") == 0) {
+            sort_type = 1;
+        } else {
+            reply(out, "Invalid top type. Use 'stock' or 'loan'.\n");
+            return CMD_USAGE;
+        }
+        // 输出数组不超过图书总数，top 2000000000这样的k不会一次申请巨大的内存
+        size_t books = count_books(*head);
+        if ((size_t)k > books) k = (int)books;
+        BookNode **top = (BookNode **)malloc((k > 0 ? k : 1) * sizeof(BookNode *));
+        if (top == NULL) {
+            reply(out, "Error: k is too large.\n");
+            return CMD_FAILED;
+        }
+        int n = top_k_books(*head, sort_type, k, top);
+        if (n == 0) {
+            reply(out, "No books in the library.\n");
+        }
+        for (int i = 0; i < n; i++) {
+            fprintf(out, "[%d] ISBN: %s, Title: %s, Author: %s, Stock: %d, Loaned: %d\n",
+                    i + 1, top[i]->isbn, top[i]->title, top[i]->author, top[i]->stock, top[i]->loaned);
+        }
+        free(top);
+        if (n == 0) return CMD_NOT_FOUND;
+    }
+
+    // 处理report命令
+    else if (strcmp(cmd, "report") == 0) {
+        generate_report_to(*head, out);//调用logic.c的报告生成函数
+    } 
+    // 处理compact命令：先保存快照，再丢弃快照已包含的借阅记录
+    else if (strcmp(cmd, "compact") == 0) {
+        uint64_t checkpoint = loan_log_seq();
+        if (persist_books_snapshot(PERSISTENCE_FILE, *head) != 0) {
+            reply(out, "错误：保存数据失败，未压缩借阅记录\n");
+            return CMD_FAILED;
+        }
+        *saved_generation = book_list_generation(*head);
+        long dropped = compact_loan_log(checkpoint, 0);
+        if (dropped < 0) {
+            reply(out, "错误：压缩借阅记录失败\n");
+            return CMD_FAILED;
+        }
+        reply(out, "已压缩借阅记录，移除 %ld 条已保存的记录\n", dropped);
+    }
+    // 处理export命令
+    else if (strncmp(cmd, "export", 6) == 0) {
+        // TODO: 解析导出命令
+        char format[5], filename[MAX_FILENAME_LEN], option[10] = "";
+        if (sscanf(input, "export %4s %49s %9s", format, filename, option) < 2) {
+            reply(out, "Invalid format. Usage: export <csv|json> <filename>\n");
+            return CMD_USAGE;
+        }
+        if (strcmp(format, "csv") != 0 && strcmp(format, "json") != 0) {
+            reply(out, "Invalid format. Use 'csv' or 'json'.\n");
+            return CMD_USAGE;
+        }
+        if (*head == NULL) {
+            reply(out, "No books in the library.\n");
+            return CMD_NOT_FOUND;
+        }
+        int written;
+        if (strcmp(format, "csv") == 0) {
+            written = export_to_csv(filename, *head);
+        } else if (strcmp(option, "compact") == 0) {
+            written = write_books_json(filename, *head, JSON_STYLE_COMPACT);
+        } else {
+            written = export_to_json(filename, *head);
+        }
+        if (written != 0) {
+            reply(out, "Error: failed to write %s\n", filename);
+            return CMD_FAILED;
+        }
+        reply(out, "Data exported to %s\n", filename);
+    } 
+    // 处理import命令（批量导入）
+    else if (strcmp(cmd, "import") == 0) {
+        char format[5], filename[MAX_FILENAME_LEN];
+        if (sscanf(input, "import %4s %49s", format, filename) != 2 || strcmp(format, "csv") != 0) {
+            reply(out, "Invalid format. Usage: import csv <filename>\n");
+            return CMD_USAGE;
+        }
+        CsvImportStats stats;
+        int imported = import_from_csv(filename, head, &stats);
+        if (imported != 0) {
+            if (imported == -1) {
+                reply(out, "Error: cannot read %s\n", filename);
             } else {
-                printf("Invalid format. Use 'csv' or 'json'.\n");
+                reply(out, "Error: out of memory while importing %s\n", filename);
             }
-        } 
-        // 处理未知命令
-        else {
-            printf("Unknown command. Type 'help' for usage.\n");
+            return CMD_FAILED;
+        }
+        for (size_t i = 0; i < stats.invalid && i < CSV_MAX_WARNINGS; i++) {
+            reply(out, "Warning: record %zu in %s is malformed, skipped\n", stats.invalid_records[i], filename);
         }
+        if (stats.invalid > CSV_MAX_WARNINGS) {
+            reply(out, "Warning: %zu more malformed records skipped\n", stats.invalid - CSV_MAX_WARNINGS);
+        }
+        reply(out, "Imported %zu books from %s (%zu duplicates, %zu invalid rows skipped) in %.3f s, %.0f rows/s\n",
+                   stats.imported, filename, stats.duplicates, stats.invalid, stats.seconds,
+                   stats.seconds > 0 ? stats.rows / stats.seconds : 0.0);
+    }
+    // 处理未知命令
+    else {
+        reply(out, "Unknown command. Type 'help' for usage.\n");
+        return CMD_USAGE;
     }
+    return CMD_OK;
 }
 
-int main() {
+// 当前时间（秒，高精度）
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 主命令解析循环
+ *
+ * 交互模式下显示提示符；批处理模式下不显示提示符，结束时向stderr报告命令数和吞吐量。
+ * 空行和以#开头的注释行忽略。
+ *
+ * @param saved_generation 最近一次保存时链表的修改计数（compact保存后更新）
+ */
+void command_loop(BookNode **head, uint64_t *saved_generation) {// 接收图书链表的头指针（二级指针，用于修改链表）
+    char input[MAX_INPUT_LEN];
+    char cmd[20];
+    size_t line = 0, commands = 0, failed = 0;
+    double start = now_seconds();
+
+    while (1) {
+        if (!g_cli.batch) printf("> "); // 显示输入提示符
+        if (!fgets(input, sizeof(input), stdin)) { // 读取用户输入
+            break; // 输入错误或EOF时退出
+        }
+        line++;
+
+        // 移除末尾换行符
+        size_t len = strlen(input);
+        if (len > 0 && input[len - 1] == '\n') {
+            input[len - 1] = '\0';
+        }
+
+        // 解析命令的第一个单词（比如"add"、"help"）
+        if (sscanf(input, "%19s", cmd) != 1 || cmd[0] == '#') {
+            continue;// 空输入和注释则忽略
+        }
+        // 处理exit命令
+        if (strcmp(cmd, "exit") == 0) {
+            break;
+        }
+        int status = run_command(head, saved_generation, input, cmd, stdout);
+        commands++;
+        failed += (status != CMD_OK);
+        if (g_cli.status) printf("%zu %d\n", line, status);
+    }
+
+    if (g_cli.batch) {
+        double elapsed = now_seconds() - start;
+        fprintf(stderr, "Processed %zu commands (%zu failed) in %.3f s, %.0f commands/s\n",
+                commands, failed, elapsed, elapsed > 0 ? commands / elapsed : 0.0);
+    }
+}
+
+/**
+ * @brief 服务器模式的命令上下文
+ */
+typedef struct {
+    BookNode **head;             // 图书链表头指针的地址
+    uint64_t *saved_generation;  // 最近一次保存时链表的修改计数
+} ServeContext;
+
+/**
+ * @brief 判断命令是否只读（服务器模式下只读命令持读锁并发执行）
+ *
+ * sort、compact会修改链表或写文件，与add、loan一样独占执行（export、import在服务器模式下不可用）。
+ */
+static int command_is_read_only(const char *line) {
+    char cmd[20];
+    if (sscanf(line, "%19s", cmd) != 1) return 1;
+    return strcmp(cmd, "isbn") == 0 || strcmp(cmd, "search") == 0 || strcmp(cmd, "top") == 0 ||
+           strcmp(cmd, "report") == 0 || strcmp(cmd, "help") == 0;
+}
+
+/**
+ * @brief 服务器模式下执行一条命令（server.c在读写锁保护下调用）
+ *
+ * export、import由客户端指定文件路径，会以服务器用户的身份读写任意文件；
+ * TCP端口本机所有用户都能连接，所以服务器模式下拒绝这两个命令。
+ */
+static int serve_command(void *ctx, const char *line, FILE *out) {
+    ServeContext *serve = (ServeContext *)ctx;
+    char cmd[20];
+    if (sscanf(line, "%19s", cmd) != 1) return CMD_OK;
+    if (strncmp(cmd, "export", 6) == 0 || strcmp(cmd, "import") == 0) {
+        fprintf(out, "Error: %s is not available in server mode.\n", cmd);
+        return CMD_REJECTED;
+    }
+    int status = run_command(serve->head, serve->saved_generation, line, cmd, out);
+    if (!command_is_read_only(line)) {
+        // 仍持有写锁：建好推迟的三元组索引，并发的search不再修改索引
+        book_index_prepare(*serve->head);
+    }
+    return status;
+}
+
+int main(int argc, char **argv) {
+    // 解析运行模式：默认stdin不是终端（管道、重定向）时进入批处理模式
+    int batch = -1;
+    ServerConfig server = {0};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "-b") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--interactive") == 0 || strcmp(argv[i], "-i") == 0) {
+            batch = 0;
+        } else if (strcmp(argv[i], "--status") == 0 || strcmp(argv[i], "-s") == 0) {
+            g_cli.status = 1;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            server.unix_path = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc &&
+                   (server.tcp_port = atoi(argv[i + 1])) > 0 && server.tcp_port <= 65535) {
+            i++;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc &&
+                   (server.workers = atoi(argv[i + 1])) > 0) {
+            i++;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    g_cli.batch = (batch >= 0) ? batch : !isatty(STDIN_FILENO);
+    if (g_cli.status) g_cli.batch = 1;
+    if (g_cli.batch) {
+        // 全缓冲：成千上万条命令的输出按块写出，而不是每行一次
+        setvbuf(stdout, NULL, _IOFBF, BATCH_OUTPUT_BUFFER);
+    }
+
     BookNode *head = NULL;
 
-    // 尝试从持久化文件加载数据(加载已有图书数据)
-    BookNode *loaded = load_books_from_json(PERSISTENCE_FILE);
+    // 尝试从持久化文件加载数据(加载已有图书数据)，没有二进制快照时读取旧的JSON数据文件
+    int migrate = 0;
+    BookNode *loaded = load_books_snapshot(PERSISTENCE_FILE);
     if (loaded) {
         head = loaded;
-        printf("Loaded library data from %s\n", PERSISTENCE_FILE);
+        info("Loaded library data from %s\n", PERSISTENCE_FILE);
+    } else if ((loaded = load_books_from_json(LEGACY_PERSISTENCE_FILE)) != NULL) {
+        head = loaded;
+        migrate = 1; // 退出时写成二进制快照
+        info("Loaded library data from %s\n", LEGACY_PERSISTENCE_FILE);
     } else {
-        printf("No existing library data found. Starting with empty library.\n");
+        info("No existing library data found. Starting with empty library.\n");
     }
 
-    // 加载历史借阅记录
-    load_loans(head);
+    // 加载历史借阅记录（回放了新借阅的话链表已改变，退出时需要保存以推进检查点）
+    uint64_t saved_generation = book_list_generation(head);
+    load_loans(head, g_cli.batch ? stderr : stdout); // 与info()相同：批处理模式写到stderr
 
-    printf("Library Management System (Type 'help' for commands)\n");
-    command_loop(&head);
+    int exit_code = 0;
+    if (server.unix_path != NULL || server.tcp_port > 0) {
+        // 服务器模式：目录常驻内存，命令来自套接字，停止后照常保存
+        ServeContext serve = {&head, &saved_generation};
+        server.run = serve_command;
+        server.read_only = command_is_read_only;
+        server.ctx = &serve;
+        book_index_prepare(head); // 并发的search之前建好三元组索引
+        if (server_run(&server) != 0) exit_code = 1;
+    } else {
+        if (!g_cli.batch) printf("Library Management System (Type 'help' for commands)\n");
+        command_loop(&head, &saved_generation);
+    }
 
-    // 退出前保存数据
-    printf("Saving library data to %s...\n", PERSISTENCE_FILE);
-    if (persist_books_json(PERSISTENCE_FILE, head) == 0) {
-        printf("Data saved successfully.\n");
+    // 退出前保存数据（本次运行没有修改过链表时跳过）
+    if (!migrate && book_list_generation(head) == saved_generation) {
+        info("No changes to save.\n");
     } else {
-        printf("Warning: Failed to save library data.\n");
+        info("Saving library data to %s...\n", PERSISTENCE_FILE);
+        uint64_t checkpoint = loan_log_seq();
+        if (persist_books_snapshot(PERSISTENCE_FILE, head) == 0) {
+            info("Data saved successfully.\n");
+            // 快照已包含的借阅记录积累较多时自动压缩日志
+            compact_loan_log(checkpoint, LOG_COMPACT_MIN_RECORDS);
+        } else {
+            info("Warning: Failed to save library data.\n");
+        }
     }
 
     // 清理资源
+    loan_log_close();
     destroy_list(&head);
-    printf("Exiting program.\n");
+    info("Exiting program.\n");
 
-    return 0;
+    return exit_code;
 }
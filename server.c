@@ -0,0 +1,496 @@
+#define _GNU_SOURCE // accept4、pthread_rwlockattr_setkind_np
+#include "server.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVER_MAX_WORKERS 64      // 工作线程数上限
+#define SERVER_MAX_EVENTS 64       // 每次epoll_wait取回的事件数
+#define SERVER_READS_PER_TURN 16   // 工作线程每轮最多读取的次数，之后把连接交还epoll（避免一个客户端占住线程）
+#define SERVER_SEND_TIMEOUT_MS 5000 // 客户端不读取回复时等待的最长时间，超时断开连接
+
+/**
+ * @brief epoll事件对应的对象种类
+ */
+typedef enum {
+    SRC_UNIX_LISTENER, // Unix域监听套接字
+    SRC_TCP_LISTENER,  // TCP监听套接字
+    SRC_WAKE,          // 信号处理函数写入的自管道
+    SRC_CLIENT         // 客户端连接
+} SourceKind;
+
+/**
+ * @brief epoll_event.data.ptr指向的对象（客户端连接以它作为第一个成员）
+ */
+typedef struct {
+    SourceKind kind;
+    int fd;
+} EpollSource;
+
+/**
+ * @brief 客户端连接
+ *
+ * 注册时带EPOLLONESHOT：可读后只交给一个工作线程，处理完再重新注册，
+ * 因此同一连接的命令按顺序执行，缓冲区不需要加锁。
+ */
+typedef struct Conn {
+    EpollSource src;             // 必须是第一个成员
+    struct Conn *next_job;       // 任务队列中的下一个连接
+    struct Conn *prev, *next;    // 连接表（停止时关闭所有连接）
+    int discard;                 // 正在丢弃超长行的剩余部分
+    size_t len;                  // 缓冲区中未处理的字节数
+    char buf[SERVER_LINE_MAX];   // 尚未收到换行符的输入
+} Conn;
+
+/**
+ * @brief 服务器运行状态
+ */
+typedef struct {
+    const ServerConfig *config;
+    int epfd;
+    pthread_rwlock_t lock;       // 目录读写锁：只读命令共享，其余命令独占
+    pthread_mutex_t mutex;       // 保护任务队列、连接表和stopping
+    pthread_cond_t ready;        // 任务队列非空或停止
+    Conn *queue_head, *queue_tail;
+    Conn *conns;
+    int stopping;
+} Server;
+
+// 自管道写端，信号处理函数唤醒epoll_wait（原子变量：处理函数可能在任意线程上运行）
+static _Atomic int g_wake_fd = -1;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    int saved = errno;
+    if (write(g_wake_fd, "", 1) < 0) {
+        // 管道已满说明已经唤醒过
+    }
+    errno = saved;
+}
+
+// 创建并监听Unix域套接字（权限0600，只有服务器用户能连接）；路径上遗留的套接字文件在无人监听时删除
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "错误：套接字路径过长：%s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        // 能连上说明另一个服务器正在使用这个路径，否则是上次没有正常退出留下的
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int in_use = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (in_use) {
+            fprintf(stderr, "错误：%s 已有服务器在监听\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+    // 绑定后、开始监听前改权限，此前没有客户端能连上
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || chmod(path, 0600) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "错误：无法监听 %s：%s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 创建并监听本机TCP端口（只绑定127.0.0.1）
+static int listen_tcp(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "错误：无法监听 127.0.0.1:%d：%s\n", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 工作线程数：配置值，或在线CPU数（至少2个，一个慢客户端不会挡住其他连接）
+static int server_workers(const ServerConfig *config) {
+    long n = config->workers;
+    if (n <= 0) {
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < 2) n = 2;
+    }
+    return n > SERVER_MAX_WORKERS ? SERVER_MAX_WORKERS : (int)n;
+}
+
+// 等待套接字可写；被信号打断时按剩余时间继续等待，超时或出错返回-1
+static int wait_writable(int fd, int timeout_ms) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int remaining = timeout_ms;
+    for (;;) {
+        struct pollfd p = {fd, POLLOUT, 0};
+        int n = poll(&p, 1, remaining);
+        if (n > 0) return 0;
+        if (n == 0 || errno != EINTR) return -1;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long elapsed = (long)(now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (elapsed >= timeout_ms) return -1;
+        remaining = timeout_ms - (int)elapsed;
+    }
+}
+
+// 把回复全部发出；客户端暂时不读时等待可写，超时或出错返回-1
+static int send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n > 0) {
+            data += n;
+            len -= (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+            wait_writable(fd, SERVER_SEND_TIMEOUT_MS) == 0) {
+            continue;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// 执行一行命令，回复写到out；返回1表示客户端要求关闭连接
+static int conn_execute(Server *s, char *line, FILE *out) {
+    size_t len = strlen(line);
+    if (len > 0 && line[len - 1] == '\r') line[len - 1] = '\0'; // telnet等客户端发送CRLF
+
+    char cmd[8];
+    if (sscanf(line, "%7s", cmd) != 1 || cmd[0] == '#') {
+        return 0; // 空行和注释忽略，不回复
+    }
+    if (strcmp(cmd, "exit") == 0 || strcmp(cmd, "quit") == 0) {
+        return 1;
+    }
+
+    const ServerConfig *config = s->config;
+    if (config->read_only(line)) {
+        pthread_rwlock_rdlock(&s->lock);
+    } else {
+        pthread_rwlock_wrlock(&s->lock);
+    }
+    int status = config->run(config->ctx, line, out);
+    pthread_rwlock_unlock(&s->lock);
+    fprintf(out, "= %d\n", status);
+    return 0;
+}
+
+// 执行缓冲区中所有完整的行（eof时最后一行可以没有换行符）；返回1表示关闭连接
+static int conn_lines(Server *s, Conn *c, FILE *out, int eof) {
+    size_t start = 0;
+    int quit = 0;
+    while (!quit && start < c->len) {
+        char *nl = (char *)memchr(c->buf + start, '\n', c->len - start);
+        if (nl == NULL) {
+            if (eof && !c->discard) {
+                c->buf[c->len < sizeof(c->buf) ? c->len : sizeof(c->buf) - 1] = '\0';
+                quit = conn_execute(s, c->buf + start, out);
+                start = c->len;
+            }
+            break;
+        }
+        *nl = '\0';
+        if (c->discard) {
+            c->discard = 0; // 超长行到此结束
+        } else {
+            quit = conn_execute(s, c->buf + start, out);
+        }
+        start = (size_t)(nl - c->buf) + 1;
+    }
+
+    // 未完成的行移到缓冲区开头；缓冲区已满仍没有换行符时拒绝这一行
+    c->len -= start;
+    memmove(c->buf, c->buf + start, c->len);
+    if (c->len == sizeof(c->buf)) {
+        if (!c->discard) fprintf(out, "Line too long (max %d bytes)\n= 1\n", SERVER_LINE_MAX - 1);
+        c->discard = 1;
+        c->len = 0;
+    }
+    return quit;
+}
+
+// 读取连接上已到达的数据并执行其中的命令，回复整块发出；返回-1表示应关闭连接
+static int conn_serve(Server *s, Conn *c) {
+    char *reply = NULL;
+    size_t reply_len = 0;
+    FILE *out = open_memstream(&reply, &reply_len);
+    if (out == NULL) return -1;
+
+    int done = 0;
+    for (int turn = 0; !done && turn < SERVER_READS_PER_TURN; turn++) {
+        ssize_t n = read(c->src.fd, c->buf + c->len, sizeof(c->buf) - c->len);
+        if (n < 0 && errno == EINTR) {
+            turn--;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            // 对方关闭写端：执行没有换行符的最后一行后关闭连接
+            conn_lines(s, c, out, 1);
+            done = 1;
+            break;
+        }
+        c->len += (size_t)n;
+        done = conn_lines(s, c, out, 0);
+    }
+
+    int failed = (fclose(out) != 0);
+    if (!failed && reply_len > 0) failed = send_all(c->src.fd, reply, reply_len);
+    free(reply);
+    return (done || failed) ? -1 : 0;
+}
+
+static void conn_close(Server *s, Conn *c) {
+    pthread_mutex_lock(&s->mutex);
+    if (c->prev) c->prev->next = c->next;
+    else s->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    pthread_mutex_unlock(&s->mutex);
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, c->src.fd, NULL);
+    close(c->src.fd);
+    free(c);
+}
+
+// 工作线程：从队列取可读的连接处理，处理完重新注册到epoll；停止时先处理完队列中的连接
+static void *server_worker(void *arg) {
+    Server *s = (Server *)arg;
+    for (;;) {
+        pthread_mutex_lock(&s->mutex);
+        while (s->queue_head == NULL && !s->stopping) {
+            pthread_cond_wait(&s->ready, &s->mutex);
+        }
+        Conn *c = s->queue_head;
+        if (c != NULL) {
+            s->queue_head = c->next_job;
+            if (s->queue_head == NULL) s->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&s->mutex);
+        if (c == NULL) return NULL;
+
+        if (conn_serve(s, c) != 0) {
+            conn_close(s, c);
+            continue;
+        }
+        // 持有队列锁重新注册：事件一到主线程就会把连接入队（也要先拿这把锁），
+        // 下一个处理它的工作线程因此能看到本线程对连接缓冲区的修改
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = c};
+        pthread_mutex_lock(&s->mutex);
+        int rearmed = (epoll_ctl(s->epfd, EPOLL_CTL_MOD, c->src.fd, &ev) == 0);
+        pthread_mutex_unlock(&s->mutex);
+        if (!rearmed) conn_close(s, c);
+    }
+}
+
+static void server_enqueue(Server *s, Conn *c) {
+    pthread_mutex_lock(&s->mutex);
+    c->next_job = NULL;
+    if (s->queue_tail) s->queue_tail->next_job = c;
+    else s->queue_head = c;
+    s->queue_tail = c;
+    pthread_cond_signal(&s->ready);
+    pthread_mutex_unlock(&s->mutex);
+}
+
+// 接受监听套接字上所有等待的连接
+static void server_accept(Server *s, const EpollSource *listener) {
+    for (;;) {
+        int fd = accept4(listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return; // 没有更多连接，或描述符用尽（下次可读时重试）
+        }
+        if (listener->kind == SRC_TCP_LISTENER) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        Conn *c = (Conn *)calloc(1, sizeof(Conn));
+        if (c == NULL) {
+            close(fd);
+            continue;
+        }
+        c->src.kind = SRC_CLIENT;
+        c->src.fd = fd;
+        pthread_mutex_lock(&s->mutex);
+        c->next = s->conns;
+        if (s->conns) s->conns->prev = c;
+        s->conns = c;
+        pthread_mutex_unlock(&s->mutex);
+
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = c};
+        if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            conn_close(s, c);
+        }
+    }
+}
+
+int server_run(const ServerConfig *config) {
+    Server s;
+    memset(&s, 0, sizeof(s));
+    s.config = config;
+
+    EpollSource sources[3];
+    int nsources = 0;
+    int wake[2] = {-1, -1};
+    int ok = 1;
+
+    if (config->unix_path != NULL) {
+        int fd = listen_unix(config->unix_path);
+        if (fd < 0) ok = 0;
+        else sources[nsources++] = (EpollSource){SRC_UNIX_LISTENER, fd};
+    }
+    if (ok && config->tcp_port > 0) {
+        int fd = listen_tcp(config->tcp_port);
+        if (fd < 0) ok = 0;
+        else sources[nsources++] = (EpollSource){SRC_TCP_LISTENER, fd};
+    }
+    if (ok && pipe2(wake, O_NONBLOCK | O_CLOEXEC) != 0) {
+        perror("pipe2");
+        ok = 0;
+    }
+    if (ok) {
+        sources[nsources++] = (EpollSource){SRC_WAKE, wake[0]};
+        s.epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (s.epfd < 0) {
+            perror("epoll_create1");
+            ok = 0;
+        }
+    }
+    for (int i = 0; ok && i < nsources; i++) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &sources[i]};
+        if (epoll_ctl(s.epfd, EPOLL_CTL_ADD, sources[i].fd, &ev) != 0) {
+            perror("epoll_ctl");
+            ok = 0;
+        }
+    }
+    if (!ok) {
+        for (int i = 0; i < nsources; i++) close(sources[i].fd);
+        if (wake[1] >= 0) close(wake[1]);
+        if (s.epfd > 0) close(s.epfd);
+        if (config->unix_path != NULL && nsources > 0 && sources[0].kind == SRC_UNIX_LISTENER) {
+            unlink(config->unix_path);
+        }
+        return -1;
+    }
+
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    // glibc默认读优先，持续不断的查询会让add/loan一直拿不到锁；改为写优先
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&s.lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&s.mutex, NULL);
+    pthread_cond_init(&s.ready, NULL);
+
+    // SIGINT/SIGTERM写自管道唤醒主线程，正常停止后由调用者保存数据。
+    // SA_RESTART让工作线程中被打断的read/send自动重启；poll/epoll_wait不受它影响，各自处理EINTR
+    g_wake_fd = wake[1];
+    struct sigaction sa, old_int, old_term;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    int nworkers = server_workers(config);
+    pthread_t workers[SERVER_MAX_WORKERS];
+    int started = 0;
+    while (started < nworkers && pthread_create(&workers[started], NULL, server_worker, &s) == 0) {
+        started++;
+    }
+
+    int stop = (started == 0);
+    if (stop) {
+        fprintf(stderr, "错误：无法创建工作线程\n");
+    } else {
+        if (config->unix_path != NULL) printf("Listening on unix:%s\n", config->unix_path);
+        if (config->tcp_port > 0) printf("Listening on 127.0.0.1:%d\n", config->tcp_port);
+        printf("Serving with %d worker threads (SIGINT/SIGTERM to stop)\n", started);
+        fflush(stdout);
+    }
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!stop) {
+        int n = epoll_wait(s.epfd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            EpollSource *src = (EpollSource *)events[i].data.ptr;
+            if (src->kind == SRC_CLIENT) {
+                server_enqueue(&s, (Conn *)src);
+            } else if (src->kind == SRC_WAKE) {
+                stop = 1;
+            } else {
+                server_accept(&s, src);
+            }
+        }
+    }
+
+    // 停止：工作线程执行完已排队的命令后退出，再关闭剩余连接
+    pthread_mutex_lock(&s.mutex);
+    s.stopping = 1;
+    pthread_cond_broadcast(&s.ready);
+    pthread_mutex_unlock(&s.mutex);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    while (s.conns != NULL) conn_close(&s, s.conns);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    g_wake_fd = -1;
+    for (int i = 0; i < nsources; i++) close(sources[i].fd);
+    close(wake[1]);
+    close(s.epfd);
+    if (config->unix_path != NULL) unlink(config->unix_path);
+
+    pthread_cond_destroy(&s.ready);
+    pthread_mutex_destroy(&s.mutex);
+    pthread_rwlock_destroy(&s.lock);
+    printf("Server stopped.\n");
+    fflush(stdout);
+    return started == 0 ? -1 : 0;
+}
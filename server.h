@@ -0,0 +1,50 @@
+#ifndef LIBRARY_SERVER_H
+#define LIBRARY_SERVER_H
+
+#include <stdio.h>
+
+#define SERVER_LINE_MAX 1024 // 一条命令的最大长度（含换行符），超长的行不执行，回复状态码1
+
+/**
+ * @brief 执行一条命令
+ *
+ * 在读写锁保护下调用：read_only返回非0的命令持读锁，可能与其他只读命令并发执行；
+ * 其余命令持写锁，与所有命令互斥。
+ *
+ * @param ctx ServerConfig.ctx
+ * @param line 整行命令（已去掉换行符）
+ * @param out 命令输出（发回给客户端）
+ * @return int 状态码，写在回复的结束行中
+ */
+typedef int (*ServerCommandFn)(void *ctx, const char *line, FILE *out);
+
+/**
+ * @brief 判断命令是否只读（不修改目录、不写文件）
+ */
+typedef int (*ServerReadOnlyFn)(const char *line);
+
+/**
+ * @brief 服务器配置
+ */
+typedef struct {
+    const char *unix_path; // Unix域套接字路径，NULL表示不监听
+    int tcp_port;          // 本机TCP端口（只绑定127.0.0.1），0表示不监听
+    int workers;           // 工作线程数，0表示按CPU数
+    ServerCommandFn run;   // 命令执行函数
+    ServerReadOnlyFn read_only; // 只读命令判断
+    void *ctx;             // 传给run的上下文
+} ServerConfig;
+
+/**
+ * @brief 以服务器模式运行，直到收到SIGINT/SIGTERM
+ *
+ * 主线程用epoll等待连接和可读事件，把可读的连接交给工作线程池。
+ * 协议按行：每行一条命令（语法同交互模式），每条命令的回复是命令输出加一行"= <状态码>"；
+ * exit/quit关闭连接。同一连接上的命令按顺序执行。
+ *
+ * @param config 服务器配置
+ * @return int 0=正常停止, -1=监听失败
+ */
+int server_run(const ServerConfig *config);
+
+#endif // LIBRARY_SERVER_H
@@ -1,227 +1,2019 @@
 #include "logic.h"
 #include "data.h"
-#include "cJSON.h"
+#include "store.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
-// 1. 记录借阅操作到二进制文件
-void log_loan(const char *isbn, int quantity) {
-    if (isbn == NULL || quantity <= 0) return;
+#define LOAN_LOG_FILE "loan_records.bin"         // 借阅记录文件
+#define LOAN_LOG_TMP "loan_records.bin.tmp"      // 升级/压缩日志时的临时文件
+#define LOG_BUFFER_RECORDS 256   // 写缓冲区容量（条）
+#define LOG_FLUSH_RECORDS 64     // 缓冲满这么多条就写盘
+#define LOG_FLUSH_INTERVAL 2     // 缓冲区中最早的记录等待超过这么多秒就写盘（后台线程每秒检查一次）
+#define REPLAY_PARALLEL_MIN_BYTES (8u << 20) // 待回放部分至少这么大才并行回放
+#define REPLAY_MAX_THREADS 32                // 并行回放的最大线程数
+#define REPLAY_CHUNK_BLOCKS (1u << 17)       // 每个读取线程每轮解析的记录块数（3MB）
 
-    // 打开二进制追加文件
-    FILE *fp = fopen("loan_records.bin", "ab");
-    if (fp == NULL) {
-        printf("错误：暂无借阅记录文件\n");
-        return;
+/*
+ * 借阅日志v3格式（所有整数按小端存储，与编译器和平台无关）：
+ *   文件头24字节：magic "LNLG" | u32 版本(3) | u32 字节序标记0x01020304 | u32 记录块大小(24)
+ *                | u64 文件中第一条记录的序号（压缩掉的前缀记录数）
+ *   记录块24字节：u64 紧凑ISBN键 | i64 借阅时间(Unix秒) | i32 数量 | u32 前20字节的CRC32
+ *   紧凑键为ISBN_KEY_NONE（非纯数字ISBN）时紧跟一个24字节续块：char isbn[20] | u32 CRC32
+ * v2与v3的区别只是文件头没有序号字段（16字节，序号从0开始），可继续追加记录。
+ * v1格式是没有文件头的LoanRecordV1结构体原样转储（56字节/条），只读兼容。
+ */
+#define LOANLOG_MAGIC "LNLG"
+#define LOANLOG_VERSION 3
+#define LOANLOG_BOM 0x01020304u
+#define LOANLOG_HEADER_V2 16
+#define LOANLOG_HEADER_SIZE 24
+#define LOANLOG_BLOCK_SIZE 24
+
+// v1借阅记录结构体（ISBN+数量+时间字符串）
+typedef struct {
+    char isbn[20];   // isbn
+    int quantity;    // 借阅数量
+    char time[30];   // 借阅时间
+} LoanRecordV1;
+
+// 长期打开的借阅日志：记录编码后先进入进程内缓冲区，按条数/时间间隔/退出时批量写盘。
+// 写盘失败时记录留在缓冲区等待重试，序号不会出现空洞
+static struct {
+    pthread_mutex_t lock;                                       // 保护缓冲区（记录借阅的线程与后台写盘线程）
+    pthread_cond_t wake;                                        // 唤醒后台写盘线程（停止时）
+    pthread_t flusher;                                          // 后台写盘线程：按时间间隔写盘
+    int flusher_running;                                        // 后台写盘线程是否在运行
+    int flusher_stop;                                           // 通知后台写盘线程退出
+    int write_failed;                                           // 上次写盘失败（只提示一次）
+    FILE *fp;                                                   // 日志文件（首次写入时打开，退出时关闭）
+    unsigned char buf[LOG_BUFFER_RECORDS * 2 * LOANLOG_BLOCK_SIZE]; // 待写盘的编码数据（每条最多两块）
+    size_t pending;                                             // 缓冲区中的记录数
+    size_t pending_bytes;                                       // 缓冲区中的字节数
+    time_t first_pending;                                       // 缓冲区中最早一条记录的时间
+    int exit_hooked;                                            // 是否已注册atexit
+    int seq_known;                                              // 下面三项是否已确定
+    uint64_t base_seq;                                          // 日志文件中第一条记录的序号
+    uint64_t next_seq;                                          // 下一条记录的序号（含缓冲区中的记录）
+    uint64_t end_offset;                                        // 已写盘部分的文件大小（0表示未知，如v1文件）
+} g_loan_log = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+
+// 最近一次加载的快照所包含的借阅日志位置（检查点），load_loans从这里开始回放
+static struct {
+    uint64_t seq;    // 快照已包含序号小于seq的记录
+    uint64_t base;   // 生成快照时日志文件头中的序号
+    uint64_t offset; // 检查点在该日志文件中的字节偏移（0表示未知）
+} g_snapshot;
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// CRC32查表（并行回放的读取线程、后台写盘线程可能同时第一次用到，由pthread_once保证只建一次）
+static uint32_t crc32_table[256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc32_table[i] = c;
+    }
+}
+
+// CRC32（IEEE 802.3多项式，查表法）
+static uint32_t crc32_calc(const unsigned char *data, size_t len) {
+    pthread_once(&crc32_once, crc32_init);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// 编码一条v2记录到out，返回写入字节数（24，或带续块的48）
+static size_t encode_record(unsigned char *out, const char *isbn, int quantity, int64_t when) {
+    IsbnKey key = isbn_pack(isbn);
+    put_u64(out, key);
+    put_u64(out + 8, (uint64_t)when);
+    put_u32(out + 16, (uint32_t)quantity);
+    put_u32(out + 20, crc32_calc(out, 20));
+    if (key != ISBN_KEY_NONE) return LOANLOG_BLOCK_SIZE;
+
+    // 非纯数字ISBN：续块保存原字符串
+    unsigned char *ext = out + LOANLOG_BLOCK_SIZE;
+    memset(ext, 0, 20);
+    strncpy((char *)ext, isbn, 19);
+    put_u32(ext + 20, crc32_calc(ext, 20));
+    return 2 * LOANLOG_BLOCK_SIZE;
+}
+
+// 写v3文件头，base_seq为文件中第一条记录的序号
+static int write_header(FILE *fp, uint64_t base_seq) {
+    unsigned char header[LOANLOG_HEADER_SIZE];
+    memcpy(header, LOANLOG_MAGIC, 4);
+    put_u32(header + 4, LOANLOG_VERSION);
+    put_u32(header + 8, LOANLOG_BOM);
+    put_u32(header + 12, LOANLOG_BLOCK_SIZE);
+    put_u64(header + 16, base_seq);
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header) ? 0 : -1;
+}
+
+/*
+ * 只读输入文件：整个文件映射进内存，解析器直接在映射上原地解析，不再经过中转缓冲区。
+ * 普通文件用mmap并提示顺序访问；mmap失败或不是普通文件（管道等）时用read()读进内存。
+ * JSON加载、借阅日志回放和CSV导入共用。
+ */
+typedef struct {
+    const unsigned char *data; // 文件内容
+    size_t size;               // 字节数
+    size_t pos;                // 解析位置
+    int mapped;                // 1=mmap映射，0=read()读入的堆内存
+} InputFile;
+
+// 打开并映射/读入整个文件，成功返回0，打不开或读取出错返回-1
+static int input_open(InputFile *in, const char *filename) {
+    memset(in, 0, sizeof(*in));
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    int regular = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+    if (regular && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            in->data = (const unsigned char *)map;
+            in->size = (size_t)st.st_size;
+            in->mapped = 1;
+            return 0;
+        }
+    }
+
+    // 退回read()：按文件大小（未知时64KB）分配，不够再翻倍，短读继续读到文件结束
+    size_t cap = (regular && st.st_size > 0 && (uint64_t)st.st_size < SIZE_MAX) ? (size_t)st.st_size + 1 : 64 * 1024;
+    unsigned char *buf = (unsigned char *)malloc(cap);
+    size_t len = 0;
+    while (buf != NULL) {
+        if (len == cap) {
+            unsigned char *grown = (cap <= SIZE_MAX / 2) ? (unsigned char *)realloc(buf, cap * 2) : NULL;
+            if (grown == NULL) {
+                free(buf);
+                buf = NULL;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(buf);
+            buf = NULL;
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fd);
+    if (buf == NULL) return -1;
+    in->data = buf;
+    in->size = len;
+    return 0;
+}
+
+static void input_close(InputFile *in) {
+    if (in->mapped) {
+        munmap((void *)in->data, in->size);
+    } else {
+        free((void *)in->data);
+    }
+    memset(in, 0, sizeof(*in));
+}
+
+// 读取文件头，返回版本：0=空文件，1=v1，2/3=带文件头，-1=无法识别（带magic但版本/字节序不支持）
+// 解析位置停在第一条记录处（v1为文件开头），*base_seq为第一条记录的序号（v1/v2为0）
+static int read_header(InputFile *in, uint64_t *base_seq) {
+    const unsigned char *header = in->data;
+    *base_seq = 0;
+    in->pos = 0;
+    if (in->size == 0) return 0;
+    if (in->size < 4 || memcmp(header, LOANLOG_MAGIC, 4) != 0) return 1;
+    if (in->size < LOANLOG_HEADER_V2 || get_u32(header + 8) != LOANLOG_BOM ||
+        get_u32(header + 12) != LOANLOG_BLOCK_SIZE) {
+        return -1;
+    }
+    uint32_t version = get_u32(header + 4);
+    if (version == 2) {
+        in->pos = LOANLOG_HEADER_V2;
+        return 2;
+    }
+    if (version != 3 || in->size < LOANLOG_HEADER_SIZE) return -1;
+    *base_seq = get_u64(header + 16);
+    in->pos = LOANLOG_HEADER_SIZE;
+    return 3;
+}
+
+// v1时间字符串转Unix秒（按本地时间），解析失败返回0
+static int64_t parse_v1_time(const char *text) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(text, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+        return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return (int64_t)mktime(&tm);
+}
+
+// 从日志中读出的一条记录
+typedef struct {
+    IsbnKey key;       // 紧凑ISBN键
+    int quantity;      // 借阅数量
+    int valid;         // CRC校验是否通过
+    const char *isbn;  // ISBN字符串（紧凑键记录为NULL，需要时再还原）
+    char isbn_buf[20]; // isbn指向的存储
+    const unsigned char *raw; // 按当前格式编码的记录（重写日志时原样写出），v2/v3直接指向文件内容
+    size_t raw_len;    // raw的字节数
+    unsigned char raw_buf[2 * LOANLOG_BLOCK_SIZE]; // v1记录转码后的存储
+} LogRecord;
+
+// 读取下一条记录，成功返回1，文件结束（或末尾记录不完整）返回0
+// 每条记录都占一个序号，包括CRC校验失败的记录
+static int read_record(InputFile *in, int version, LogRecord *rec) {
+    size_t left = in->size - in->pos;
+    if (version == 1) {
+        LoanRecordV1 record;
+        if (left < sizeof(record)) return 0;
+        memcpy(&record, in->data + in->pos, sizeof(record));
+        in->pos += sizeof(record);
+        record.isbn[sizeof(record.isbn)-1] = '\0';
+        record.time[sizeof(record.time)-1] = '\0';
+        memcpy(rec->isbn_buf, record.isbn, sizeof(rec->isbn_buf));
+        rec->isbn = rec->isbn_buf;
+        rec->key = isbn_pack(record.isbn);
+        rec->quantity = record.quantity;
+        rec->valid = 1;
+        rec->raw_len = encode_record(rec->raw_buf, record.isbn, record.quantity, parse_v1_time(record.time));
+        rec->raw = rec->raw_buf;
+        return 1;
+    }
+
+    const unsigned char *block = in->data + in->pos;
+    if (left < LOANLOG_BLOCK_SIZE) return 0;
+    rec->raw = block;
+    rec->valid = (get_u32(block + 20) == crc32_calc(block, 20));
+    rec->key = get_u64(block);
+    rec->quantity = (int)get_u32(block + 16);
+    rec->isbn = NULL;
+    rec->raw_len = LOANLOG_BLOCK_SIZE;
+    if (rec->key == ISBN_KEY_NONE) {
+        // 读取续块中的ISBN字符串
+        const unsigned char *ext = block + LOANLOG_BLOCK_SIZE;
+        if (left < 2 * LOANLOG_BLOCK_SIZE) return 0;
+        rec->valid = rec->valid && (get_u32(ext + 20) == crc32_calc(ext, 20));
+        memcpy(rec->isbn_buf, ext, sizeof(rec->isbn_buf));
+        rec->isbn_buf[sizeof(rec->isbn_buf)-1] = '\0';
+        rec->isbn = rec->isbn_buf;
+        rec->raw_len += LOANLOG_BLOCK_SIZE;
+    }
+    in->pos += rec->raw_len;
+    return 1;
+}
+
+// 确定日志的序号和写盘位置（只在第一次需要时扫描一遍文件），失败返回-1
+static int loan_log_locate(void) {
+    if (g_loan_log.seq_known) return 0;
+
+    uint64_t base = g_snapshot.seq; // 没有日志文件时，新日志接着快照的检查点编号
+    uint64_t count = 0, end = 0;
+    InputFile in;
+    if (input_open(&in, LOAN_LOG_FILE) == 0) {
+        uint64_t header_base;
+        int version = read_header(&in, &header_base);
+        if (version == -1) {
+            input_close(&in);
+            fprintf(stderr, "错误：借阅记录文件格式无法识别\n");
+            return -1;
+        }
+        if (version != 0) {
+            base = header_base;
+            LogRecord rec;
+            while (read_record(&in, version, &rec)) count++;
+            if (version != 1) end = in.pos;
+        }
+        input_close(&in);
+    }
+    g_loan_log.base_seq = base;
+    g_loan_log.next_seq = base + count + g_loan_log.pending;
+    g_loan_log.end_offset = end;
+    g_loan_log.seq_known = 1;
+    return 0;
+}
+
+// 把文件内容刷到磁盘后关闭，成功返回0
+static int sync_close(FILE *fp) {
+    int ret = (fflush(fp) == 0 && fsync(fileno(fp)) == 0) ? 0 : -1;
+    if (fclose(fp) != 0) ret = -1;
+    return ret;
+}
+
+// 同步path所在的目录，让改名本身也落盘（尽力而为，失败不影响结果）
+static void sync_parent_dir(const char *path) {
+    char dir[256];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path) + (slash == path), path);
+    }
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// 重写日志文件：丢弃序号小于upto_seq的记录，其余记录按v3格式写入临时文件后改名覆盖
+// 返回丢弃的记录数，失败返回-1（调用前日志写句柄必须已关闭）
+static long loan_log_rewrite(uint64_t upto_seq) {
+    InputFile src;
+    if (input_open(&src, LOAN_LOG_FILE) != 0) return 0;
+    uint64_t seq;
+    int version = read_header(&src, &seq);
+    if (version <= 0) {
+        input_close(&src);
+        return version;
+    }
+    if (upto_seq < seq) upto_seq = seq;
+
+    FILE *dst = fopen(LOAN_LOG_TMP, "wb");
+    if (dst == NULL) {
+        input_close(&src);
+        return -1;
+    }
+    int ret = write_header(dst, upto_seq);
+    long dropped = 0;
+    LogRecord rec;
+    while (ret == 0 && read_record(&src, version, &rec)) {
+        if (seq++ < upto_seq) {
+            dropped++;
+        } else if (fwrite(rec.raw, 1, rec.raw_len, dst) != rec.raw_len) {
+            ret = -1;
+        }
+    }
+    uint64_t end = (uint64_t)ftell(dst);
+    input_close(&src);
+    if (sync_close(dst) != 0) ret = -1;
+    if (ret == 0 && rename(LOAN_LOG_TMP, LOAN_LOG_FILE) != 0) ret = -1;
+    if (ret != 0) {
+        remove(LOAN_LOG_TMP);
+        return -1;
+    }
+    sync_parent_dir(LOAN_LOG_FILE);
+
+    // 新文件头从upto_seq编号；文件中实际的记录数可能少于预期（日志被截断），以文件为准
+    g_loan_log.base_seq = upto_seq;
+    g_loan_log.next_seq = (seq > upto_seq ? seq : upto_seq) + g_loan_log.pending;
+    g_loan_log.end_offset = end;
+    g_loan_log.seq_known = 1;
+    return dropped;
+}
+
+// 退出时写盘并关闭日志
+static void loan_log_atexit(void) {
+    loan_log_close();
+}
+
+static int loan_log_flush_locked(void);
+
+// 后台写盘线程：每秒检查一次，缓冲区中最早的记录等待超过LOG_FLUSH_INTERVAL秒就写盘，
+// 没有后续借阅时记录也不会一直留在缓冲区
+static void *loan_log_flusher(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_loan_log.lock);
+    while (!g_loan_log.flusher_stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += 1;
+        pthread_cond_timedwait(&g_loan_log.wake, &g_loan_log.lock, &until);
+        if (g_loan_log.pending > 0 && time(NULL) - g_loan_log.first_pending >= LOG_FLUSH_INTERVAL) {
+            loan_log_flush_locked();
+        }
+    }
+    pthread_mutex_unlock(&g_loan_log.lock);
+    return NULL;
+}
+
+// 确保日志文件已打开（空文件写入文件头，v1文件先升级），失败返回-1
+static int loan_log_open(void) {
+    if (g_loan_log.fp != NULL) return 0;
+    if (loan_log_locate() != 0) return -1;
+
+    int version = 0;
+    uint64_t base;
+    InputFile probe;
+    if (input_open(&probe, LOAN_LOG_FILE) == 0) {
+        version = read_header(&probe, &base);
+        input_close(&probe);
+    }
+    if (version == -1) {
+        fprintf(stderr, "错误：借阅记录文件格式无法识别\n");
+        return -1;
+    }
+    if (version == 1 && loan_log_rewrite(0) < 0) {
+        fprintf(stderr, "错误：借阅记录文件升级到v3格式失败\n");
+        return -1;
+    }
+
+    g_loan_log.fp = fopen(LOAN_LOG_FILE, "ab");
+    if (g_loan_log.fp == NULL) {
+        fprintf(stderr, "错误：暂无借阅记录文件\n");
+        return -1;
+    }
+    if (version == 0) {
+        // 新日志：文件头记录第一条记录的序号
+        g_loan_log.base_seq = g_loan_log.next_seq - g_loan_log.pending;
+        if (write_header(g_loan_log.fp, g_loan_log.base_seq) != 0) {
+            fclose(g_loan_log.fp);
+            g_loan_log.fp = NULL;
+            return -1;
+        }
+    }
+    fseek(g_loan_log.fp, 0, SEEK_END);
+    g_loan_log.end_offset = (uint64_t)ftell(g_loan_log.fp);
+    if (!g_loan_log.exit_hooked) {
+        atexit(loan_log_atexit);
+        g_loan_log.exit_hooked = 1;
+    }
+    if (!g_loan_log.flusher_running) {
+        g_loan_log.flusher_stop = 0;
+        g_loan_log.flusher_running = (pthread_create(&g_loan_log.flusher, NULL, loan_log_flusher, NULL) == 0);
+    }
+    return 0;
+}
+
+// 把data一次性写入日志文件，成功返回0。失败时把文件截回写入前的大小（不留下半条记录），
+// 关闭句柄，下次写入时重新打开
+static int loan_log_write(const unsigned char *data, size_t len) {
+    if (len == 0) return 0;
+    if (loan_log_open() != 0) return -1;
+    if (fwrite(data, 1, len, g_loan_log.fp) == len && fflush(g_loan_log.fp) == 0) {
+        g_loan_log.end_offset += len;
+        return 0;
+    }
+    fclose(g_loan_log.fp);
+    g_loan_log.fp = NULL;
+    if (truncate(LOAN_LOG_FILE, (off_t)g_loan_log.end_offset) != 0) {
+        g_loan_log.seq_known = 0; // 截不回去：下次写入前重新扫描日志确定序号
+    }
+    return -1;
+}
+
+// 写出缓冲区中的记录（调用方持有g_loan_log.lock）；失败时记录留在缓冲区，下次写盘时重试
+static int loan_log_flush_locked(void) {
+    if (loan_log_write(g_loan_log.buf, g_loan_log.pending_bytes) != 0) {
+        if (!g_loan_log.write_failed) {
+            fprintf(stderr, "警告：借阅记录写盘失败，%zu 条记录暂存在内存中，稍后重试\n", g_loan_log.pending);
+        }
+        g_loan_log.write_failed = 1;
+        return -1;
+    }
+    g_loan_log.write_failed = 0;
+    g_loan_log.pending = 0;
+    g_loan_log.pending_bytes = 0;
+    return 0;
+}
+
+int loan_log_flush(void) {
+    pthread_mutex_lock(&g_loan_log.lock);
+    int ret = loan_log_flush_locked();
+    pthread_mutex_unlock(&g_loan_log.lock);
+    return ret;
+}
+
+void loan_log_close(void) {
+    pthread_mutex_lock(&g_loan_log.lock);
+    if (loan_log_flush_locked() != 0) {
+        fprintf(stderr, "错误：%zu 条借阅记录未能写盘\n", g_loan_log.pending);
+        g_loan_log.pending = 0;
+        g_loan_log.pending_bytes = 0;
+    }
+    g_loan_log.flusher_stop = 1;
+    pthread_cond_signal(&g_loan_log.wake);
+    int running = g_loan_log.flusher_running;
+    g_loan_log.flusher_running = 0;
+    pthread_mutex_unlock(&g_loan_log.lock);
+    if (running) pthread_join(g_loan_log.flusher, NULL);
+
+    if (g_loan_log.fp != NULL) {
+        fclose(g_loan_log.fp);
+        g_loan_log.fp = NULL;
+    }
+}
+
+uint64_t loan_log_seq(void) {
+    if (loan_log_locate() != 0) return 0;
+    return g_loan_log.next_seq;
+}
+
+long compact_loan_log(uint64_t upto_seq, uint64_t min_records) {
+    if (loan_log_flush() != 0) return -1; // 缓冲的记录写不出去时不压缩，以免丢掉它们
+    loan_log_close(); // 写句柄指向改名前的文件，压缩后在下次写入时重新打开
+    if (loan_log_locate() != 0) return -1;
+    if (upto_seq > g_loan_log.next_seq) upto_seq = g_loan_log.next_seq;
+    if (upto_seq <= g_loan_log.base_seq || upto_seq - g_loan_log.base_seq < min_records) return 0;
+    return loan_log_rewrite(upto_seq);
+}
+
+// 1. 记录借阅操作到二进制文件（编码后进入写缓冲区，按策略批量写盘）
+int log_loan(const char *isbn, int quantity) {
+    if (isbn == NULL || isbn[0] == '\0' || quantity <= 0) return -1;
+    pthread_mutex_lock(&g_loan_log.lock);
+    // 缓冲区已满（之前的写盘都失败了）时先写盘，仍写不出去则拒绝这条记录
+    if (loan_log_open() != 0 ||
+        (g_loan_log.pending == LOG_BUFFER_RECORDS && loan_log_flush_locked() != 0)) {
+        pthread_mutex_unlock(&g_loan_log.lock);
+        return -1;
     }
 
-    // 定义借阅记录结构体（ISBN+数量+时间）
-    typedef struct {
-        char isbn[20];   // isbn
-        int quantity;    // 借阅数量
-        char time[30];   // 借阅时间
-    } LoanRecord;
-
-    LoanRecord record; //临时存储 “待写入文件的单条借阅记录” 的容器
-    // 赋值ISBN（避免数组越界）
-    strncpy(record.isbn, isbn, sizeof(record.isbn)-1);
-    record.isbn[sizeof(record.isbn)-1] = '\0';
-    // 赋值借阅数量
-    record.quantity = quantity;
-    // 生成当前时间
     time_t now = time(NULL);
-    strftime(record.time, sizeof(record.time), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    if (g_loan_log.pending == 0) g_loan_log.first_pending = now;
+    g_loan_log.pending_bytes += encode_record(g_loan_log.buf + g_loan_log.pending_bytes, isbn, quantity, (int64_t)now);
+    g_loan_log.pending++;
+    g_loan_log.next_seq++;
 
-    // 写入二进制数据
-    fwrite(&record, sizeof(LoanRecord), 1, fp);
-    fclose(fp);
+    // 写盘策略：积累够条数，或最早的记录已等待超过时间间隔（没有后续记录时由后台线程写盘）；
+    // 这里写盘失败不影响本条记录，它留在缓冲区等待重试
+    if (g_loan_log.pending >= LOG_FLUSH_RECORDS || now - g_loan_log.first_pending >= LOG_FLUSH_INTERVAL) {
+        loan_log_flush_locked();
+    }
+    pthread_mutex_unlock(&g_loan_log.lock);
+    return 0;
+}
+
+// 批量记录借阅：先写出缓冲区中的记录，再把整批记录一次写入；写入成功后才推进序号
+int log_loan_batch(const LoanEntry *entries, size_t count) {
+    if (entries == NULL || count == 0) return 0;
+    unsigned char *data = (unsigned char *)malloc(count * 2 * LOANLOG_BLOCK_SIZE);
+    if (data == NULL) return -1;
+    int64_t now = (int64_t)time(NULL);
+    size_t len = 0, records = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].isbn == NULL || entries[i].isbn[0] == '\0' || entries[i].quantity <= 0) continue; // 跳过非法记录
+        len += encode_record(data + len, entries[i].isbn, entries[i].quantity, now);
+        records++;
+    }
+
+    pthread_mutex_lock(&g_loan_log.lock);
+    int ret = -1;
+    if (loan_log_flush_locked() == 0 && loan_log_write(data, len) == 0) { // 先写缓冲区保证记录顺序
+        g_loan_log.next_seq += records;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&g_loan_log.lock);
+    free(data);
+    return ret;
 }
 
-// 2. 从二进制文件加载借阅记录
-void load_loans(BookNode *head) {
+// 回放用的ISBN -> 节点连接表（链表没有索引时临时构建，开放寻址）
+typedef struct {
+    IsbnKey key;    // 紧凑键，ISBN_KEY_NONE表示按字符串比较
+    BookNode *node; // 图书节点，NULL表示空槽
+} JoinSlot;
+
+// 回放上下文：连接表与统计
+typedef struct {
+    BookNode *head;     // 图书链表
+    FILE *log;          // 提示和警告的输出流
+    JoinSlot *slots;    // 临时连接表（链表自带索引时为NULL，直接复用索引）
+    size_t mask;        // 槽位数-1
+    size_t records;     // 回放的记录数
+    size_t applied;     // 成功应用的记录数
+    size_t skipped;     // 检查点之前、已包含在快照中的记录数
+} ReplayCtx;
+
+// 连接表哈希：数字ISBN用紧凑键，其余用FNV-1a
+static size_t join_hash(IsbnKey key, const char *isbn) {
+    if (key != ISBN_KEY_NONE) {
+        uint64_t h = key * 0x9E3779B97F4A7C15ull;
+        return (size_t)(h ^ (h >> 32));
+    }
+    size_t h = 2166136261u;
+    while (*isbn) {
+        h ^= (unsigned char)*isbn++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 在连接表中查找，返回命中槽位或空槽位
+static JoinSlot *join_probe(const ReplayCtx *ctx, IsbnKey key, const char *isbn) {
+    size_t pos = join_hash(key, isbn) & ctx->mask;
+    while (ctx->slots[pos].node != NULL) {
+        const JoinSlot *slot = &ctx->slots[pos];
+        if (slot->key == key && (key != ISBN_KEY_NONE || strcmp(slot->node->isbn, isbn) == 0)) break;
+        pos = (pos + 1) & ctx->mask;
+    }
+    return &ctx->slots[pos];
+}
+
+// 准备回放：链表有索引则直接复用，否则遍历一次链表建连接表（失败时退回逐条查找）
+static void replay_begin(ReplayCtx *ctx, BookNode *head, FILE *log) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->head = head;
+    ctx->log = log;
+    if (book_index_of(head) != NULL) return;
+
+    size_t count = 0;
+    for (BookNode *cur = head; cur != NULL; cur = cur->next) count++;
+    size_t cap = 16;
+    while (cap < count * 2) cap *= 2;
+    ctx->slots = (JoinSlot *)calloc(cap, sizeof(JoinSlot));
+    if (ctx->slots == NULL) return;
+    ctx->mask = cap - 1;
+    for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+        IsbnKey key = isbn_pack(cur->isbn);
+        JoinSlot *slot = join_probe(ctx, key, cur->isbn);
+        if (slot->node == NULL) { // 重复ISBN保留链表中靠前的一本，与逐个查找一致
+            slot->key = key;
+            slot->node = cur;
+        }
+    }
+}
+
+// 按ISBN找到要回放的图书：有连接表时探测连接表，否则走链表索引（只读，可多线程并发调用）
+static BookNode *replay_lookup(const ReplayCtx *ctx, IsbnKey key, const char *isbn) {
+    return (ctx->slots != NULL) ? join_probe(ctx, key, isbn)->node
+                                : search_by_isbn_key(ctx->head, key, isbn);
+}
+
+// 校验一条借阅能否应用到current：数量非法或超过库存时向log打印警告并返回0
+static int loan_applicable(FILE *log, const BookNode *current, int quantity) {
+    if (quantity <= 0) {
+        // 忽略非法借阅数量
+        fprintf(log, "警告：忽略非法借阅数量 %d for ISBN %s\n", quantity, current->isbn);
+        return 0;
+    }
+    if (current->stock < quantity) {
+        // 如果借阅量大于库存，跳过并打印警告
+        fprintf(log, "警告：ISBN %s 借阅 %d 超过库存 %d，已跳过该记录\n",
+               current->isbn, quantity, current->stock);
+        return 0;
+    }
+    return 1;
+}
+
+// 回放一条借阅记录：探测连接表，校验数量和库存后更新图书
+// isbn可为NULL（紧凑键记录），只在需要打印警告时才还原字符串
+static void apply_loan(ReplayCtx *ctx, IsbnKey key, const char *isbn, int quantity) {
+    ctx->records++;
+    BookNode *current = replay_lookup(ctx, key, isbn);
+    if (current == NULL) {
+        return; // 图书已不存在，忽略该记录
+    }
+    if (loan_applicable(ctx->log, current, quantity)) {
+        // 匹配成功，更新这本书的库存和已借出量
+        // 已借出数量 += 借阅数量，库存数量 -= 借阅数量
+        book_set_counts(ctx->head, current, current->stock - quantity, current->loaned + quantity);
+        ctx->applied++;
+    }
+}
+
+/*
+ * 并行回放（v2/v3日志）：按轮处理，每轮把一段日志切成每线程REPLAY_CHUNK_BLOCKS块，
+ *   1. 读取线程各自解析一段，查到图书后按ISBN哈希放进分片队列；
+ *   2. 应用线程每个负责一个分片，按段的顺序依次应用该分片的队列。
+ * 同一ISBN总在同一分片，且段按日志顺序应用，所以每本书的借阅顺序不变，超库存跳过规则照常生效；
+ * 不同分片修改的是不同的BookNode，不需要加锁。应用线程只改节点的库存/已借出，
+ * 索引中的列存储和统计量在全部回放完后单线程同步一次。
+ * 段边界可能落在非纯数字ISBN记录的主块和续块之间：续块以非空ISBN字符串开头，
+ * 而主块的键为0，所以前一块键为0时当前块是续块，整条记录归前一段解析。
+ * 读取线程直接解析共享的只读文件映射，不需要各自的文件句柄和读缓冲区。
+ */
+
+// 分片队列中的一条借阅：已查到的图书和借阅数量
+typedef struct {
+    BookNode *node; // 图书节点
+    int quantity;   // 借阅数量
+} ShardOp;
+
+// 一个读取线程给一个分片准备的借阅队列
+typedef struct {
+    ShardOp *ops;
+    size_t len;
+    size_t cap;
+} ShardQueue;
+
+// 并行回放参数（loan_replay_config调整）
+static struct {
+    int threads;         // 线程数，0表示按在线CPU数
+    size_t min_bytes;    // 待回放部分至少这么大才并行回放
+    size_t chunk_blocks; // 每个读取线程每轮解析的记录块数
+    int fail_round;      // 按内存不足处理的轮次（从1开始），0表示不模拟
+} g_replay = {0, REPLAY_PARALLEL_MIN_BYTES, REPLAY_CHUNK_BLOCKS, 0};
+
+void loan_replay_config(int threads, size_t min_bytes, size_t chunk_blocks) {
+    g_replay.threads = threads > 0 ? threads : 0;
+    g_replay.min_bytes = min_bytes;
+    g_replay.chunk_blocks = chunk_blocks > 0 ? chunk_blocks : REPLAY_CHUNK_BLOCKS;
+}
+
+void loan_replay_fail_round(int round) {
+    g_replay.fail_round = round > 0 ? round : 0;
+}
+
+// 读取线程：解析[begin, end)内的记录
+typedef struct {
+    const ReplayCtx *ctx;  // 回放上下文（只读）
+    const unsigned char *data; // 日志文件内容（共享的只读映射）
+    uint64_t range_start;  // 本次回放的起点（记录边界）
+    uint64_t range_end;    // 本次回放的终点（最后一个完整块之后）
+    uint64_t begin, end;   // 本轮负责的字节范围
+    uint64_t stop;         // 本轮实际解析到的位置（跨过end的续块已读完）
+    int shards;            // 分片数
+    ShardQueue *queues;    // 每个分片一个队列
+    size_t records;        // 本轮读到的记录数（含校验失败的）
+    size_t valid;          // 本轮校验通过的记录数
+    int failed;            // 内存分配失败
+} ReplayReader;
+
+// 应用线程：应用一个分片在本轮所有读取线程中的队列
+typedef struct {
+    ReplayReader *readers; // 读取线程（按段的顺序）
+    int nreaders;          // 读取线程数
+    int shard;             // 负责的分片
+    size_t applied;        // 成功应用的记录数
+} ReplayApplier;
+
+static void *replay_read_chunk(void *arg) {
+    ReplayReader *r = (ReplayReader *)arg;
+    for (int s = 0; s < r->shards; s++) r->queues[s].len = 0;
+    r->records = r->valid = 0;
+    r->stop = r->begin;
+    if (r->begin >= r->end) return NULL;
+
+    // 前一块的键为0时首块是续块，所在记录归前一段；跨到下一段的续块照常读取
+    const unsigned char *p = r->data + r->begin;
+    const unsigned char *end = r->data + r->end;
+    const unsigned char *limit = r->data + r->range_end;
+    if (r->begin > r->range_start && get_u64(p - LOANLOG_BLOCK_SIZE) == ISBN_KEY_NONE) p += LOANLOG_BLOCK_SIZE;
+
+    char isbn_buf[20];
+    while (p < end) {
+        IsbnKey key = get_u64(p);
+        int valid = (get_u32(p + 20) == crc32_calc(p, 20));
+        int quantity = (int)get_u32(p + 16);
+        const char *isbn = NULL;
+        if (key == ISBN_KEY_NONE) {
+            const unsigned char *ext = p + LOANLOG_BLOCK_SIZE;
+            if (ext + LOANLOG_BLOCK_SIZE > limit) break; // 文件末尾不完整的记录
+            valid = valid && (get_u32(ext + 20) == crc32_calc(ext, 20));
+            memcpy(isbn_buf, ext, sizeof(isbn_buf));
+            isbn_buf[sizeof(isbn_buf)-1] = '\0';
+            isbn = isbn_buf;
+            p += LOANLOG_BLOCK_SIZE;
+        }
+        p += LOANLOG_BLOCK_SIZE;
+        r->records++;
+        if (!valid) {
+            fprintf(r->ctx->log, "警告：借阅记录校验失败，已跳过\n");
+            continue;
+        }
+        r->valid++;
+
+        BookNode *node = replay_lookup(r->ctx, key, isbn);
+        if (node == NULL) continue; // 图书已不存在，忽略该记录
+        ShardQueue *q = &r->queues[join_hash(key, isbn) % (size_t)r->shards];
+        if (q->len == q->cap) {
+            size_t cap = q->cap ? q->cap * 2 : 1024;
+            ShardOp *ops = (ShardOp *)realloc(q->ops, cap * sizeof(ShardOp));
+            if (ops == NULL) {
+                r->failed = 1;
+                return NULL;
+            }
+            q->ops = ops;
+            q->cap = cap;
+        }
+        q->ops[q->len].node = node;
+        q->ops[q->len].quantity = quantity;
+        q->len++;
+    }
+    r->stop = (uint64_t)(p - r->data);
+    return NULL;
+}
+
+static void *replay_apply_shard(void *arg) {
+    ReplayApplier *a = (ReplayApplier *)arg;
+    for (int w = 0; w < a->nreaders; w++) {
+        const ShardQueue *q = &a->readers[w].queues[a->shard];
+        for (size_t i = 0; i < q->len; i++) {
+            BookNode *current = q->ops[i].node;
+            int quantity = q->ops[i].quantity;
+            if (loan_applicable(a->readers[w].ctx->log, current, quantity)) {
+                current->stock -= quantity;
+                current->loaned += quantity;
+                a->applied++;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 用n个线程执行fn(args[i])，创建线程失败的就在当前线程执行
+static void run_threads(void *(*fn)(void *), void *args, size_t arg_size, int n) {
+    pthread_t tids[REPLAY_MAX_THREADS];
+    int started[REPLAY_MAX_THREADS];
+    for (int i = 0; i < n; i++) {
+        void *arg = (char *)args + (size_t)i * arg_size;
+        started[i] = (pthread_create(&tids[i], NULL, fn, arg) == 0);
+        if (!started[i]) fn(arg);
+    }
+    for (int i = 0; i < n; i++) {
+        if (started[i]) pthread_join(tids[i], NULL);
+    }
+}
+
+// 并行回放的线程数：配置值或在线CPU数，不超过REPLAY_MAX_THREADS
+static int replay_threads(void) {
+    long n = g_replay.threads > 0 ? g_replay.threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) return 1;
+    return n > REPLAY_MAX_THREADS ? REPLAY_MAX_THREADS : (int)n;
+}
+
+/*
+ * 并行回放data中[*pos, size)的v2/v3记录（*pos为记录边界），返回已应用各轮读到的记录数（含校验失败的），
+ * *pos移到最后一个已应用的轮次之后。某轮的读取线程内存不足时，这一轮整轮不应用，直接返回：
+ * 之前各轮已按日志顺序应用完，调用方从*pos起顺序回放其余记录，结果与全程顺序回放相同。
+ */
+static long long replay_parallel(ReplayCtx *ctx, const unsigned char *data, uint64_t *pos_io, uint64_t size, int threads) {
+    uint64_t pos = *pos_io;
+    uint64_t range_end = pos + (size - pos) / LOANLOG_BLOCK_SIZE * LOANLOG_BLOCK_SIZE;
+    size_t chunk = g_replay.chunk_blocks * LOANLOG_BLOCK_SIZE;
+    ReplayReader readers[REPLAY_MAX_THREADS];
+    ReplayApplier appliers[REPLAY_MAX_THREADS];
+    memset(readers, 0, sizeof(readers));
+    memset(appliers, 0, sizeof(appliers));
+
+    int ok = 1;
+    for (int w = 0; w < threads && ok; w++) {
+        ReplayReader *r = &readers[w];
+        r->ctx = ctx;
+        r->range_start = pos;
+        r->range_end = range_end;
+        r->data = data;
+        r->shards = threads;
+        r->queues = (ShardQueue *)calloc((size_t)threads, sizeof(ShardQueue));
+        ok = (r->queues != NULL);
+        appliers[w].readers = readers;
+        appliers[w].nreaders = threads;
+        appliers[w].shard = w;
+    }
+
+    long long records = 0;
+    int round = 0;
+    while (ok && pos < range_end) {
+        for (int w = 0; w < threads; w++) {
+            uint64_t begin = pos + (uint64_t)w * chunk;
+            readers[w].begin = begin < range_end ? begin : range_end;
+            readers[w].end = begin + chunk < range_end ? begin + chunk : range_end;
+        }
+        run_threads(replay_read_chunk, readers, sizeof(ReplayReader), threads);
+        for (int w = 0; w < threads; w++) ok = ok && !readers[w].failed;
+        if (++round == g_replay.fail_round) ok = 0;
+        if (!ok) break;
+        run_threads(replay_apply_shard, appliers, sizeof(ReplayApplier), threads);
+        for (int w = 0; w < threads; w++) {
+            records += (long long)readers[w].records;
+            ctx->records += readers[w].valid;
+        }
+        // 下一轮从最后一段实际停下的位置开始：段尾的非纯数字ISBN记录连同续块已被读完，
+        // 名义上的段尾可能正好指向这个续块，从那里顺序回放会把续块当成一条记录
+        pos = readers[threads - 1].stop;
+    }
+    *pos_io = pos;
+
+    for (int w = 0; w < threads; w++) {
+        ctx->applied += appliers[w].applied;
+        for (int s = 0; readers[w].queues != NULL && s < threads; s++) free(readers[w].queues[s].ops);
+        free(readers[w].queues);
+    }
+
+    // 应用线程只改了节点，统一把库存/已借出同步到索引的列存储和统计量
+    if (book_index_of(ctx->head) != NULL) {
+        for (BookNode *cur = ctx->head; cur != NULL; cur = cur->next) {
+            book_set_counts(ctx->head, cur, cur->stock, cur->loaned);
+        }
+    }
+    if (!ok) fprintf(ctx->log, "提示：并行回放内存不足，其余借阅记录改为顺序回放\n");
+    return records;
+}
+
+// 当前时间（秒，高精度）
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 2. 从二进制文件加载借阅记录（兼容v1/v2/v3格式），只回放快照检查点之后的记录
+void load_loans(BookNode *head, FILE *log) {
     if (head == NULL) return; // 图书链表是空的，直接退出
 
-    FILE *fp = fopen("loan_records.bin", "rb");
-    if (fp == NULL) {
-        printf("提示：暂无借阅记录文件\n");
+    loan_log_flush(); // 先把缓冲区中的记录写盘，保证读到完整日志
+    InputFile in;
+    if (input_open(&in, LOAN_LOG_FILE) != 0) {
+        fprintf(log, "提示：暂无借阅记录文件\n");
         return;
     }
-    //结构体和log_loan中定义一样（保证读写格式一致）
-    typedef struct {
-        char isbn[20];
-        int quantity;
-        char time[30];
-    } LoanRecord;
-
-    LoanRecord record; //临时存储 “从文件中读取的单条借阅记录” 的容器
-    // 循环读取二进制文件里的每条借阅记录
-    while (fread(&record, sizeof(LoanRecord), 1, fp) == 1) {
-        BookNode *current = head;
-        while (current != NULL) {
-            // 遍历图书链表，找和当前借阅记录ISBN匹配的图书
-            if (strcmp(current->isbn, record.isbn) == 0) {
-                if (record.quantity <= 0) {
-                    // 忽略非法借阅数量
-                    printf("警告：忽略非法借阅数量 %d for ISBN %s\n", record.quantity, record.isbn);
-                } else if (current->stock < record.quantity) {
-                    // 如果借阅量大于库存，跳过并打印警告
-                    printf("警告：ISBN %s 借阅 %d 超过库存 %d，已跳过该记录\n",
-                           record.isbn, record.quantity, current->stock);
-                } else {
-                   // 匹配成功，更新这本书的库存和已借出量 
-                    current->loaned += record.quantity; // 已借出数量 += 借阅数量
-                    current->stock -= record.quantity; // 库存数量 -= 借阅数量
-                }
-                break; // 找到匹配的图书，退出图书链表的遍历
+
+    double start = now_seconds();
+    ReplayCtx ctx;
+    replay_begin(&ctx, head, log); // 连接表只建一次，之后每条记录O(1)探测
+
+    uint64_t base;
+    int version = read_header(&in, &base);
+    uint64_t seq = base;
+    if (version == -1) {
+        fprintf(log, "错误：借阅记录文件格式无法识别\n");
+    } else if (version != 0) {
+        uint64_t data_start = in.pos;
+        uint64_t size = in.size;
+
+        // 快照记录的检查点属于同一个日志文件（文件头序号一致）时直接跳过已包含的前缀，
+        // 否则（日志已压缩或快照较旧）从头读取并按序号跳过
+        if (version != 1 && g_snapshot.offset >= data_start && g_snapshot.offset <= size &&
+            g_snapshot.base == base && g_snapshot.seq >= base) {
+            in.pos = (size_t)g_snapshot.offset;
+            seq = g_snapshot.seq;
+        }
+
+        // 检查点偏移不可用时，按序号跳过快照已包含的记录
+        LogRecord rec;
+        while (seq < g_snapshot.seq && read_record(&in, version, &rec)) {
+            seq++;
+            ctx.skipped++;
+        }
+
+        // 待回放部分较大时先并行回放，并行回放中途失败或有剩余时从停下的位置顺序回放
+        uint64_t pos = in.pos;
+        int threads = replay_threads();
+        if (version != 1 && threads > 1 && size - pos >= g_replay.min_bytes) {
+            seq += (uint64_t)replay_parallel(&ctx, in.data, &pos, size, threads);
+            in.pos = (size_t)pos;
+        }
+        while (read_record(&in, version, &rec)) {
+            seq++;
+            if (!rec.valid) {
+                fprintf(log, "警告：借阅记录校验失败，已跳过\n");
+                continue;
             }
-            current = current->next; // 找下一本
+            apply_loan(&ctx, rec.key, rec.isbn, rec.quantity);
         }
+
+        // 回放完顺便记下日志位置，之后保存快照和追加记录不必再扫描
+        g_loan_log.base_seq = base;
+        g_loan_log.next_seq = seq;
+        g_loan_log.end_offset = (version != 1) ? size : 0;
+        g_loan_log.seq_known = 1;
+    }
+    input_close(&in);
+    free(ctx.slots);
+
+    // 报告回放吞吐量
+    if (ctx.records > 0) {
+        double elapsed = now_seconds() - start;
+        fprintf(log, "已回放借阅记录 %zu 条（应用 %zu 条），耗时 %.3f 秒，%.0f 条/秒\n",
+               ctx.records, ctx.applied, elapsed, elapsed > 0 ? ctx.records / elapsed : 0.0);
+    }
+    if (ctx.skipped > 0) {
+        fprintf(log, "提示：%zu 条借阅记录已包含在快照中，未重复回放\n", ctx.skipped);
     }
-    fclose(fp);
 }
 
-// 3. 持久化图书到JSON文件
-int persist_books_json(const char *filename, BookNode *head) {
+// 带缓冲的输出流：先写进固定大小的缓冲区，满了再整块写入文件
+#define OUT_BUFFER_SIZE (64 * 1024)
+typedef struct {
+    FILE *fp;                   // 输出文件
+    char buf[OUT_BUFFER_SIZE];  // 待写出的数据
+    size_t len;                 // 缓冲区中的字节数
+    int error;                  // 写入是否出过错
+} OutBuf;
+
+static void out_flush(OutBuf *out) {
+    if (out->len > 0 && fwrite(out->buf, 1, out->len, out->fp) != out->len) out->error = 1;
+    out->len = 0;
+}
+
+static void out_write(OutBuf *out, const char *data, size_t len) {
+    if (out->len + len > sizeof(out->buf)) {
+        out_flush(out);
+        if (len > sizeof(out->buf)) { // 超过缓冲区的数据直接写出
+            if (fwrite(data, 1, len, out->fp) != len) out->error = 1;
+            return;
+        }
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+static void out_str(OutBuf *out, const char *text) {
+    out_write(out, text, strlen(text));
+}
+
+static void out_char(OutBuf *out, char c) {
+    if (out->len == sizeof(out->buf)) out_flush(out);
+    out->buf[out->len++] = c;
+}
+
+// 输出无符号整数（手写转换，不经过printf）
+static void out_u64(OutBuf *out, uint64_t v) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) out_char(out, digits[--n]);
+}
+
+static void out_int(OutBuf *out, int v) {
+    if (v < 0) {
+        out_char(out, '-');
+        out_u64(out, (uint64_t)0 - (uint64_t)(int64_t)v);
+    } else {
+        out_u64(out, (uint64_t)v);
+    }
+}
+
+// 输出JSON字符串：加引号，转义引号、反斜杠和控制字符，其余字节（含UTF-8）原样输出
+static void json_put_string(OutBuf *out, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    out_char(out, '"');
+    const char *run = text; // 尚未输出的、不需要转义的一段
+    for (const char *p = text; *p != '\0'; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out_write(out, run, (size_t)(p - run));
+        run = p + 1;
+        out_char(out, '\\');
+        switch (c) {
+            case '"':  out_char(out, '"'); break;
+            case '\\': out_char(out, '\\'); break;
+            case '\b': out_char(out, 'b'); break;
+            case '\f': out_char(out, 'f'); break;
+            case '\n': out_char(out, 'n'); break;
+            case '\r': out_char(out, 'r'); break;
+            case '\t': out_char(out, 't'); break;
+            default:
+                out_str(out, "u00");
+                out_char(out, hex[c >> 4]);
+                out_char(out, hex[c & 0xF]);
+                break;
+        }
+    }
+    out_str(out, run);
+    out_char(out, '"');
+}
+
+// JSON输出器：在OutBuf上按格式（缩进或紧凑）输出对象成员
+typedef struct {
+    OutBuf *out;
+    int pretty;  // 是否缩进换行
+    int depth;   // 当前嵌套层数
+    int first;   // 当前对象/数组是否还没有成员
+} JsonWriter;
+
+// 开始一个成员：补逗号、换行和缩进，key非NULL时输出"key":
+static void json_member(JsonWriter *w, const char *key) {
+    if (!w->first) out_char(w->out, ',');
+    w->first = 0;
+    if (w->pretty) {
+        out_char(w->out, '\n');
+        for (int i = 0; i < w->depth; i++) out_char(w->out, '\t');
+    }
+    if (key != NULL) {
+        json_put_string(w->out, key);
+        out_str(w->out, w->pretty ? ": " : ":");
+    }
+}
+
+static void json_open(JsonWriter *w, char bracket) {
+    out_char(w->out, bracket);
+    w->depth++;
+    w->first = 1;
+}
+
+static void json_close(JsonWriter *w, char bracket) {
+    w->depth--;
+    if (w->pretty && !w->first) {
+        out_char(w->out, '\n');
+        for (int i = 0; i < w->depth; i++) out_char(w->out, '\t');
+    }
+    out_char(w->out, bracket);
+    w->first = 0;
+}
+
+static void json_string_member(JsonWriter *w, const char *key, const char *value) {
+    json_member(w, key);
+    json_put_string(w->out, value);
+}
+
+static void json_int_member(JsonWriter *w, const char *key, int value) {
+    json_member(w, key);
+    out_int(w->out, value);
+}
+
+static void json_u64_member(JsonWriter *w, const char *key, uint64_t value) {
+    json_member(w, key);
+    out_u64(w->out, value);
+}
+
+// 打开filename.tmp准备原子写入（tmp_name至少512字节），失败返回NULL
+static OutBuf *out_open_atomic(const char *filename, char *tmp_name) {
+    if (snprintf(tmp_name, 512, "%s.tmp", filename) >= 512) return NULL;
+    OutBuf *out = (OutBuf *)malloc(sizeof(OutBuf));
+    if (out == NULL) return NULL;
+    out->fp = fopen(tmp_name, "wb");
+    if (out->fp == NULL) {
+        free(out);
+        return NULL;
+    }
+    out->len = 0;
+    out->error = 0;
+    return out;
+}
+
+// 结束原子写入：写出缓冲区、fsync临时文件后改名覆盖filename，失败时删除临时文件，原文件不变
+static int out_commit_atomic(OutBuf *out, const char *tmp_name, const char *filename) {
+    out_flush(out);
+    int ret = out->error ? -1 : 0;
+    if (sync_close(out->fp) != 0) ret = -1;
+    free(out);
+    if (ret == 0 && rename(tmp_name, filename) != 0) ret = -1;
+    if (ret != 0) {
+        remove(tmp_name);
+        return -1;
+    }
+    sync_parent_dir(filename);
+    return 0;
+}
+
+// 流式写出图书JSON：边遍历链表边写入缓冲区，内存占用与图书数量无关。
+// with_checkpoint为真时（持久化）在metadata中写入借阅日志检查点
+static int write_books_json_file(const char *filename, BookNode *head, JsonStyle style, int with_checkpoint) {
     if (filename == NULL || head == NULL) return -1; //文件名或链表为空时返回-1表示失败
 
-    // 创建JSON根对象
-     cJSON *root = cJSON_CreateObject();
-    // 构建metadata子对象
-    cJSON *metadata = cJSON_CreateObject();
-    // 添加版本号
-    cJSON_AddStringToObject(metadata, "version", "1.0");
-    // 添加创建时间（格式化时间字符串，比时间戳更易读）
+    // 检查点：快照已包含的借阅日志位置，下次启动只回放之后的记录。
+    // 缓冲的记录写不出去时不能保存：检查点之后若再写入它们，下次启动会重复回放
+    int has_checkpoint = 0;
+    if (with_checkpoint) {
+        if (loan_log_flush() != 0) return -1;
+        has_checkpoint = (loan_log_locate() == 0);
+    }
+
+    // 先写临时文件，落盘后再改名覆盖，中途崩溃也不会破坏原文件
+    char tmp_name[512];
+    OutBuf *out = out_open_atomic(filename, tmp_name);
+    if (out == NULL) return -1;
+
+    JsonWriter w = {out, style == JSON_STYLE_PRETTY, 0, 1};
+    json_open(&w, '{');
+
+    // metadata：版本号、创建时间（格式化时间字符串，比时间戳更易读）和检查点
     time_t now = time(NULL);
     char create_time[30];
     strftime(create_time, sizeof(create_time), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    cJSON_AddStringToObject(metadata, "created", create_time);
-    // 把metadata添加到根对象
-    cJSON_AddItemToObject(root, "metadata", metadata);
-
-    // 遍历图书链表，构建books数组
-    cJSON *books_array = cJSON_CreateArray();
-    BookNode *current = head;
-    while (current != NULL) {
-        cJSON *book_obj = cJSON_CreateObject();
-        //字符串类型
-        cJSON_AddStringToObject(book_obj, "isbn", current->isbn);
-        cJSON_AddStringToObject(book_obj, "title", current->title);
-        cJSON_AddStringToObject(book_obj, "author", current->author);
-        //数字类型
-        cJSON_AddNumberToObject(book_obj, "stock", current->stock);
-        cJSON_AddNumberToObject(book_obj, "loaned", current->loaned);
-
-        cJSON_AddItemToArray(books_array, book_obj);
-        current = current->next; // 继续遍历下一本图书
-    }
-    // 把books数组添加到根对象
-    cJSON_AddItemToObject(root, "books", books_array);
-
-    // 生成JSON字符串并写入文件
-    char *json_str = cJSON_Print(root);
-    // 打开文件，写入JSON字符串
-    FILE *fp = fopen(filename, "w");
-    if (fp == NULL) {
-        free(json_str);
-        cJSON_Delete(root);
-        return -1;
+    json_member(&w, "metadata");
+    json_open(&w, '{');
+    json_string_member(&w, "version", "1.0");
+    json_string_member(&w, "created", create_time);
+    json_string_member(&w, "kind", with_checkpoint ? "library" : "export");
+    if (has_checkpoint) {
+        json_member(&w, "checkpoint");
+        json_open(&w, '{');
+        json_u64_member(&w, "loan_seq", g_loan_log.next_seq);
+        json_u64_member(&w, "log_base", g_loan_log.base_seq);
+        json_u64_member(&w, "log_offset", g_loan_log.end_offset);
+        json_close(&w, '}');
+    }
+    json_close(&w, '}');
+
+    // 遍历图书链表，逐本写出books数组
+    json_member(&w, "books");
+    json_open(&w, '[');
+    for (BookNode *current = head; current != NULL; current = current->next) {
+        json_member(&w, NULL);
+        json_open(&w, '{');
+        json_string_member(&w, "isbn", current->isbn);
+        json_string_member(&w, "title", current->title);
+        json_string_member(&w, "author", current->author);
+        json_int_member(&w, "stock", current->stock);
+        json_int_member(&w, "loaned", current->loaned);
+        json_close(&w, '}');
     }
-    fputs(json_str, fp); // 把JSON字符串写入文件
-    fclose(fp);
+    json_close(&w, ']');
+    json_close(&w, '}');
+    out_char(out, '\n');
+    return out_commit_atomic(out, tmp_name, filename);
+}
+
+// 3. 持久化图书到JSON文件（含借阅日志检查点）
+int persist_books_json(const char *filename, BookNode *head) {
+    return write_books_json_file(filename, head, JSON_STYLE_PRETTY, 1);
+}
+
+// 导出图书JSON：只有图书数据，不涉及借阅日志
+int write_books_json(const char *filename, BookNode *head, JsonStyle style) {
+    return write_books_json_file(filename, head, style, 0);
+}
 
-    free(json_str);   // 释放JSON字符串的内存
-    cJSON_Delete(root); // 释放JSON数组的内存
+// 查看下一个字节（不消耗），文件结束返回-1
+static int in_peek(const InputFile *in) {
+    return in->pos < in->size ? in->data[in->pos] : -1;
+}
+
+// 读取下一个字节，文件结束返回-1
+static int in_next(InputFile *in) {
+    int c = in_peek(in);
+    if (c >= 0) in->pos++;
+    return c;
+}
+
+/*
+ * 事件驱动（SAX风格）的JSON解析器：在InputFile上逐字节读取，每遇到一个值就回调一次，不构建DOM。
+ * 对象成员的键和字符串值解析进固定大小的缓冲区（超长部分截断），嵌套不超过JSON_MAX_DEPTH层，
+ * 所以额外内存是常数，与文件大小无关。
+ */
+#define JSON_MAX_DEPTH 32   // 最大嵌套层数
+#define JSON_KEY_MAX 32     // 键的最大长度（含结束符），超长截断
+#define JSON_VALUE_MAX 128  // 字符串值的最大长度（含结束符），超长截断
+
+typedef enum {
+    JSON_EV_OBJECT_BEGIN,
+    JSON_EV_OBJECT_END,
+    JSON_EV_ARRAY_BEGIN,
+    JSON_EV_ARRAY_END,
+    JSON_EV_STRING,
+    JSON_EV_NUMBER,
+    JSON_EV_LITERAL      // true/false/null
+} JsonEvent;
+
+// 事件回调：depth为值所在层数（根为0），key为它在所属对象中的键（数组元素和根为NULL），
+// text为字符串值或数字/字面量的原文，number为数字值；返回非0中止解析
+typedef int (*JsonSaxFn)(void *ctx, JsonEvent ev, int depth, const char *key, const char *text, double number);
+
+typedef struct {
+    InputFile *in;
+    JsonSaxFn fn;
+    void *ctx;
+    char value[JSON_VALUE_MAX]; // 当前字符串值/数字原文
+} JsonSax;
+
+static int sax_skip_ws(JsonSax *p) {
+    int c = in_peek(p->in);
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        p->in->pos++;
+        c = in_peek(p->in);
+    }
+    return c;
+}
+
+// 读取4位十六进制数，失败返回-1
+static long sax_hex4(JsonSax *p) {
+    long v = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = in_next(p->in);
+        if (c >= '0' && c <= '9') v = v * 16 + (c - '0');
+        else if (c >= 'a' && c <= 'f') v = v * 16 + (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v = v * 16 + (c - 'A' + 10);
+        else return -1;
+    }
+    return v;
+}
+
+// 解析字符串（开头的引号已读过），解码转义后写入out（超出size-1字节的部分丢弃），成功返回0
+static int sax_string(JsonSax *p, char *out, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        int c = in_next(p->in);
+        if (c < 0) return -1;
+        if (c == '"') break;
+        unsigned char bytes[4];
+        size_t n = 1;
+        bytes[0] = (unsigned char)c;
+        if (c == '\\') {
+            c = in_next(p->in);
+            switch (c) {
+                case '"': case '\\': case '/': bytes[0] = (unsigned char)c; break;
+                case 'b': bytes[0] = '\b'; break;
+                case 'f': bytes[0] = '\f'; break;
+                case 'n': bytes[0] = '\n'; break;
+                case 'r': bytes[0] = '\r'; break;
+                case 't': bytes[0] = '\t'; break;
+                case 'u': {
+                    long cp = sax_hex4(p);
+                    if (cp < 0) return -1;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) { // 代理对：后面必须跟低代理
+                        if (in_next(p->in) != '\\' || in_next(p->in) != 'u') return -1;
+                        long low = sax_hex4(p);
+                        if (low < 0xDC00 || low > 0xDFFF) return -1;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                        return -1;
+                    }
+                    // 编码为UTF-8
+                    if (cp < 0x80) {
+                        bytes[0] = (unsigned char)cp;
+                    } else if (cp < 0x800) {
+                        bytes[0] = (unsigned char)(0xC0 | (cp >> 6));
+                        bytes[1] = (unsigned char)(0x80 | (cp & 0x3F));
+                        n = 2;
+                    } else if (cp < 0x10000) {
+                        bytes[0] = (unsigned char)(0xE0 | (cp >> 12));
+                        bytes[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+                        bytes[2] = (unsigned char)(0x80 | (cp & 0x3F));
+                        n = 3;
+                    } else {
+                        bytes[0] = (unsigned char)(0xF0 | (cp >> 18));
+                        bytes[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+                        bytes[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+                        bytes[3] = (unsigned char)(0x80 | (cp & 0x3F));
+                        n = 4;
+                    }
+                    break;
+                }
+                default: return -1;
+            }
+        }
+        if (len + n < size) {
+            memcpy(out + len, bytes, n);
+            len += n;
+        }
+    }
+    out[len] = '\0';
     return 0;
 }
 
-// 4. 从JSON文件加载图书
+static int sax_value(JsonSax *p, int depth, const char *key);
+
+// 解析对象（开头的'{'已读过）
+static int sax_object(JsonSax *p, int depth, const char *key) {
+    if (p->fn(p->ctx, JSON_EV_OBJECT_BEGIN, depth, key, NULL, 0)) return -1;
+    char member[JSON_KEY_MAX];
+    if (sax_skip_ws(p) == '}') {
+        p->in->pos++;
+    } else {
+        for (;;) {
+            if (sax_skip_ws(p) != '"') return -1;
+            p->in->pos++;
+            if (sax_string(p, member, sizeof(member)) != 0) return -1;
+            if (sax_skip_ws(p) != ':') return -1;
+            p->in->pos++;
+            if (sax_value(p, depth + 1, member) != 0) return -1;
+            int c = sax_skip_ws(p);
+            p->in->pos++;
+            if (c == '}') break;
+            if (c != ',') return -1;
+        }
+    }
+    return p->fn(p->ctx, JSON_EV_OBJECT_END, depth, key, NULL, 0) ? -1 : 0;
+}
+
+// 解析数组（开头的'['已读过）
+static int sax_array(JsonSax *p, int depth, const char *key) {
+    if (p->fn(p->ctx, JSON_EV_ARRAY_BEGIN, depth, key, NULL, 0)) return -1;
+    if (sax_skip_ws(p) == ']') {
+        p->in->pos++;
+    } else {
+        for (;;) {
+            if (sax_value(p, depth + 1, NULL) != 0) return -1;
+            int c = sax_skip_ws(p);
+            p->in->pos++;
+            if (c == ']') break;
+            if (c != ',') return -1;
+        }
+    }
+    return p->fn(p->ctx, JSON_EV_ARRAY_END, depth, key, NULL, 0) ? -1 : 0;
+}
+
+// 解析一个值并产生对应事件，成功返回0
+static int sax_value(JsonSax *p, int depth, const char *key) {
+    if (depth >= JSON_MAX_DEPTH) return -1;
+    int c = sax_skip_ws(p);
+    if (c < 0) return -1;
+    if (c == '{' || c == '[' || c == '"') p->in->pos++;
+    if (c == '{') return sax_object(p, depth, key);
+    if (c == '[') return sax_array(p, depth, key);
+    if (c == '"') {
+        if (sax_string(p, p->value, sizeof(p->value)) != 0) return -1;
+        return p->fn(p->ctx, JSON_EV_STRING, depth, key, p->value, 0) ? -1 : 0;
+    }
+
+    // 数字或字面量：读到分隔符为止，顺便按整数累加各位数字
+    size_t len = 0;
+    size_t digits = 0;      // 累加了的数字个数
+    int integral = 1;       // 目前为止是否形如 -?[0-9]*
+    uint64_t magnitude = 0;
+    while ((c = in_peek(p->in)) >= 0 && c != ',' && c != '}' && c != ']' &&
+           c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        if (len + 1 >= sizeof(p->value)) return -1;
+        if (c >= '0' && c <= '9') {
+            if (digits < 16) magnitude = magnitude * 10 + (uint64_t)(c - '0');
+            digits++;
+        } else if (c != '-' || len != 0) {
+            integral = 0;
+        }
+        p->value[len++] = (char)c;
+        p->in->pos++;
+    }
+    p->value[len] = '\0';
+
+    // 整数快速路径：可选负号加不超过15位数字（精确可表示为double），
+    // 不以0开头（单个0除外），不必走strtod和它的locale处理
+    size_t sign = (len > 0 && p->value[0] == '-');
+    if (integral && digits > 0 && digits <= 15 && (digits == 1 || p->value[sign] != '0')) {
+        double number = sign ? -(double)magnitude : (double)magnitude;
+        return p->fn(p->ctx, JSON_EV_NUMBER, depth, key, p->value, number) ? -1 : 0;
+    }
+
+    if (strcmp(p->value, "true") == 0 || strcmp(p->value, "false") == 0 || strcmp(p->value, "null") == 0) {
+        return p->fn(p->ctx, JSON_EV_LITERAL, depth, key, p->value, 0) ? -1 : 0;
+    }
+    char *end;
+    double number = strtod(p->value, &end);
+    if (len == 0 || *end != '\0') return -1;
+    return p->fn(p->ctx, JSON_EV_NUMBER, depth, key, p->value, number) ? -1 : 0;
+}
+
+// 数字转int（超出范围的截到int范围内）
+static int sax_to_int(double number) {
+    if (number >= 2147483647.0) return 2147483647;
+    if (number <= -2147483648.0) return (-2147483647 - 1);
+    return (int)number;
+}
+
+// 图书加载器：books数组中的每个对象结束时直接建节点
+#define BOOK_FIELD_ISBN   0x01
+#define BOOK_FIELD_TITLE  0x02
+#define BOOK_FIELD_AUTHOR 0x04
+#define BOOK_FIELD_STOCK  0x08
+#define BOOK_FIELD_LOANED 0x10
+#define BOOK_FIELD_ALL    0x1F
+
+typedef struct {
+    BookNode *head;     // 重建的链表
+    int has_books;      // 是否见到了books数组
+    int in_books;       // 是否在books数组内
+    int in_metadata;    // 是否在metadata对象内
+    int in_checkpoint;  // 是否在metadata.checkpoint对象内
+    int is_library;     // metadata.kind为"library"（持久化的数据文件，检查点可信）
+    int fields;         // 当前图书已读到的字段（BOOK_FIELD_*）
+    BookNode book;      // 当前图书的字段
+    double checkpoint[3]; // loan_seq、log_base、log_offset（-1表示缺失）
+} BookLoader;
+
+static int book_loader_event(void *ctx, JsonEvent ev, int depth, const char *key, const char *text, double number) {
+    BookLoader *l = (BookLoader *)ctx;
+    if (depth == 1 && key != NULL) {
+        // 根对象的成员
+        if (strcmp(key, "books") == 0) {
+            if (ev == JSON_EV_ARRAY_BEGIN) l->has_books = l->in_books = 1;
+            if (ev == JSON_EV_ARRAY_END) l->in_books = 0;
+        } else if (strcmp(key, "metadata") == 0) {
+            l->in_metadata = (ev == JSON_EV_OBJECT_BEGIN);
+        }
+    } else if (depth == 2 && l->in_books && key == NULL) {
+        // books数组的元素
+        if (ev == JSON_EV_OBJECT_BEGIN) {
+            l->fields = 0;
+        } else if (ev == JSON_EV_OBJECT_END && l->fields == BOOK_FIELD_ALL) {
+            // 调用logic里的add_book1函数，把图书加入链表
+            add_book1(&l->head, l->book.title, l->book.author, l->book.isbn, l->book.stock, l->book.loaned);
+        }
+    } else if (depth == 3 && l->in_books && key != NULL) {
+        // 图书对象的字段，类型不匹配的字段视为缺失（整条记录会被跳过）
+        if (ev == JSON_EV_STRING) {
+            if (strcmp(key, "isbn") == 0) {
+                snprintf(l->book.isbn, sizeof(l->book.isbn), "%s", text);
+                l->fields |= BOOK_FIELD_ISBN;
+            } else if (strcmp(key, "title") == 0) {
+                snprintf(l->book.title, sizeof(l->book.title), "%s", text);
+                l->fields |= BOOK_FIELD_TITLE;
+            } else if (strcmp(key, "author") == 0) {
+                snprintf(l->book.author, sizeof(l->book.author), "%s", text);
+                l->fields |= BOOK_FIELD_AUTHOR;
+            }
+        } else if (ev == JSON_EV_NUMBER) {
+            if (strcmp(key, "stock") == 0) {
+                l->book.stock = sax_to_int(number);
+                l->fields |= BOOK_FIELD_STOCK;
+            } else if (strcmp(key, "loaned") == 0) {
+                l->book.loaned = sax_to_int(number);
+                l->fields |= BOOK_FIELD_LOANED;
+            }
+        }
+    } else if (depth == 2 && l->in_metadata && key != NULL && ev == JSON_EV_STRING && strcmp(key, "kind") == 0) {
+        l->is_library = (strcmp(text, "library") == 0);
+    } else if (depth == 2 && l->in_metadata && key != NULL && strcmp(key, "checkpoint") == 0) {
+        l->in_checkpoint = (ev == JSON_EV_OBJECT_BEGIN);
+    } else if (depth == 3 && l->in_checkpoint && key != NULL && ev == JSON_EV_NUMBER && number >= 0) {
+        if (strcmp(key, "loan_seq") == 0) l->checkpoint[0] = number;
+        else if (strcmp(key, "log_base") == 0) l->checkpoint[1] = number;
+        else if (strcmp(key, "log_offset") == 0) l->checkpoint[2] = number;
+    }
+    return 0;
+}
+
+// 4. 从JSON文件加载图书（流式解析，books数组中的对象一结束就建节点）
 BookNode *load_books_from_json(const char *filename) {
     if (filename == NULL) return NULL;  // 文件名空，返回空链表
 
-    FILE *fp = fopen(filename, "r");
-    if (fp == NULL) return NULL;  // 文件打开失败，返回空链表
-
-    // 读取文件总大小
-    // 指针移到文件末尾
-    fseek(fp, 0, SEEK_END);
-    // 获得偏移量
-    long file_size = ftell(fp); 
-    // 指针移回文件开头
-    fseek(fp, 0, SEEK_SET);  
-    // 分配内存存储文件内容
-    char *json_content = (char *)malloc(file_size + 1);
-    fread(json_content, 1, file_size, fp);  // 读取文件内容到json_content
-    json_content[file_size] = '\0';   // 手动加字符串结束符
-    fclose(fp);
-
-    // 解析根对象
-    cJSON *root = cJSON_Parse(json_content);
-    free(json_content);   // 解析完成后，释放文件内容的内存
-    if (root == NULL) return NULL;  // JSON解析失败，返回空链表
-
-    // 从根对象中取出books数组
-    cJSON *books_array = cJSON_GetObjectItem(root, "books");
-    if (books_array == NULL || !cJSON_IsArray(books_array)) {  // 校验是否是数组
-        cJSON_Delete(root);
+    InputFile in;
+    if (input_open(&in, filename) != 0) return NULL;  // 文件打开失败，返回空链表
+    // 跳过UTF-8 BOM
+    if (in.size >= 3 && memcmp(in.data, "\xEF\xBB\xBF", 3) == 0) in.pos = 3;
+
+    BookLoader loader;
+    memset(&loader, 0, sizeof(loader));
+    loader.checkpoint[0] = loader.checkpoint[1] = loader.checkpoint[2] = -1;
+    JsonSax parser = {&in, book_loader_event, &loader, {0}};
+    int ret = sax_value(&parser, 0, NULL);
+    input_close(&in);
+
+    // 解析失败或没有books数组：丢弃已建的节点，返回空链表
+    if (ret != 0 || !loader.has_books) {
+        destroy_list(&loader.head);
         return NULL;
     }
-    
-
-    BookNode *head = NULL; // 新链表的头指针
-    int array_size = cJSON_GetArraySize(books_array);  // 获取JSON数组的长度（图书数量）
-    for (int i = 0; i < array_size; i++) {
-        cJSON *book_obj = cJSON_GetArrayItem(books_array, i);
-        // 从JSON对象中取出对应字段的cJSON节点
-        cJSON *isbn = cJSON_GetObjectItem(book_obj, "isbn");
-        cJSON *title = cJSON_GetObjectItem(book_obj, "title");
-        cJSON *author = cJSON_GetObjectItem(book_obj, "author");
-        cJSON *stock = cJSON_GetObjectItem(book_obj, "stock");
-        cJSON *loaned = cJSON_GetObjectItem(book_obj, "loaned");
 
-        // 校验字段
-        if (!cJSON_IsString(isbn) || !cJSON_IsString(title) ||
-            !cJSON_IsString(author) || !cJSON_IsNumber(stock) || !cJSON_IsNumber(loaned)) {
-            continue;// 如果字段类型不匹配，跳过这条记录
+    // 读取检查点（旧快照没有检查点，借阅日志从头回放）。
+    // 只认持久化的数据文件中的检查点：用户导出的文件（含早先带检查点的导出）被当作数据文件使用时，
+    // 导出之后日志可能已被压缩或改写，按它的检查点跳过记录会悄悄丢掉借阅
+    memset(&g_snapshot, 0, sizeof(g_snapshot));
+    if (loader.is_library && loader.checkpoint[0] >= 0) {
+        g_snapshot.seq = (uint64_t)loader.checkpoint[0];
+        if (loader.checkpoint[1] >= 0 && loader.checkpoint[2] >= 0) {
+            g_snapshot.base = (uint64_t)loader.checkpoint[1];
+            g_snapshot.offset = (uint64_t)loader.checkpoint[2];
         }
+    }
+    return loader.head;  // 返回重建后的图书链表头指针
+}
 
-        // 调用logic里的add_book1函数，把图书加入链表
-        add_book1(&head, title->valuestring, author->valuestring, isbn->valuestring, stock->valueint,loaned->valueint);
+// 输出一个CSV字段：含逗号、双引号或换行时整个字段加双引号，其中的双引号写两遍（RFC 4180）
+static void csv_put_field(OutBuf *out, const char *text) {
+    size_t n = strcspn(text, ",\"\r\n");
+    if (text[n] == '\0') {
+        out_write(out, text, n); // 绝大多数字段无需引号，整段写出
+        return;
     }
+    out_char(out, '"');
+    const char *run = text;
+    for (const char *q = strchr(run, '"'); q != NULL; q = strchr(run, '"')) {
+        out_write(out, run, (size_t)(q - run) + 1);
+        out_char(out, '"');
+        run = q + 1;
+    }
+    out_str(out, run);
+    out_char(out, '"');
+}
+
+// 5. 把图书以CSV格式写到已打开的流（经64KB缓冲区写出，不用格式化输出）
+int write_books_csv(FILE *fp, BookNode *head) {
+    if (fp == NULL) return -1;
+    OutBuf *out = (OutBuf *)malloc(sizeof(OutBuf));
+    if (out == NULL) return -1;
+    out->fp = fp;
+    out->len = 0;
+    out->error = 0;
 
-    cJSON_Delete(root); // 释放cJSON数组的内存
-    return head;  // 返回重建后的图书链表头指针
+    out_str(out, "ISBN,书名,作者,库存,已借出\n");
+    for (BookNode *current = head; current != NULL; current = current->next) {
+        csv_put_field(out, current->isbn);
+        out_char(out, ',');
+        csv_put_field(out, current->title);
+        out_char(out, ',');
+        csv_put_field(out, current->author);
+        out_char(out, ',');
+        out_int(out, current->stock);
+        out_char(out, ',');
+        out_int(out, current->loaned);
+        out_char(out, '\n');
+    }
+    out_flush(out);
+    int ret = (out->error || fflush(fp) != 0) ? -1 : 0;
+    free(out);
+    return ret;
 }
 
-// 5. 导出图书到CSV文件
-void export_to_csv(const char *filename, BookNode *head) {
-    if (filename == NULL || head == NULL) return;  //文件名或图书链表为空，直接退出
+// 导出图书到CSV文件（不打印提示，由调用方根据返回值回复）
+int export_to_csv(const char *filename, BookNode *head) {
+    if (filename == NULL || head == NULL) return -1;  //文件名或图书链表为空时返回-1表示失败
 
     //打开CSV文件
     FILE *fp = fopen(filename, "w");
-    if (fp == NULL) {
-        printf("错误：无法创建CSV文件\n");
-        return;
+    if (fp == NULL) return -1;
+    int ret = write_books_csv(fp, head);
+    if (fclose(fp) != 0) ret = -1;
+    return ret;
+}
+
+/*
+ * CSV导入（RFC 4180）：字段以逗号分隔，记录以CRLF或LF结尾；字段可用双引号包围，
+ * 其中可含逗号和换行，""表示一个双引号。列顺序与export_to_csv相同：ISBN,书名,作者,库存,已借出，
+ * 首条记录第一列为"ISBN"时视为表头跳过，空行忽略。
+ * 第一遍在只读映射上校验每条记录并记下起始偏移，第二遍由book_list_push_batch回调直接把字段解析进节点。
+ */
+#define CSV_COLUMNS 5
+#define CSV_FIELD_QUOTE_ERROR -2 // 引号不匹配或闭引号后还有其他字符
+
+// 解析一个字段到out（超长截断），返回字段后的分隔符：','、'\n'（记录结束）、-1（文件结束）或CSV_FIELD_QUOTE_ERROR
+static int csv_field(InputFile *in, char *out, size_t size) {
+    const unsigned char *d = in->data;
+    size_t pos = in->pos, end = in->size, len = 0;
+    if (pos < end && d[pos] == '"') {
+        pos++;
+        while (1) {
+            if (pos >= end) {
+                in->pos = pos;
+                return CSV_FIELD_QUOTE_ERROR;
+            }
+            unsigned char c = d[pos++];
+            if (c == '"') {
+                if (pos >= end || d[pos] != '"') break;
+                pos++; // ""转义为一个双引号
+            }
+            if (len + 1 < size) out[len++] = (char)c;
+        }
+    } else {
+        while (pos < end && d[pos] != ',' && d[pos] != '\n' && d[pos] != '\r') {
+            if (len + 1 < size) out[len++] = (char)d[pos];
+            pos++;
+        }
     }
+    out[len] = '\0';
 
-    // 写入CSV表头
-    fprintf(fp, "ISBN,书名,作者,库存,已借出\n");
-    BookNode *current = head;
-    while (current != NULL) {
-        fprintf(fp, "%s,%s,%s,%d,%d\n",
-                current->isbn,
-                current->title,
-                current->author,
-                current->stock,
-                current->loaned);
-        current = current->next;
+    if (pos >= end) {
+        in->pos = pos;
+        return -1;
     }
-    fclose(fp);
+    unsigned char c = d[pos];
+    if (c == ',') {
+        in->pos = pos + 1;
+        return ',';
+    }
+    if (c == '\n' || c == '\r') {
+        pos += (c == '\r' && pos + 1 < end && d[pos + 1] == '\n') ? 2 : 1;
+        in->pos = pos;
+        return '\n';
+    }
+    in->pos = pos;
+    return CSV_FIELD_QUOTE_ERROR;
 }
 
-// 6. 导出图书到JSON文件
-void export_to_json(const char *filename, BookNode *head) {
-    // 复用persist_books_json的逻辑
-    persist_books_json(filename, head);
-}
\ No newline at end of file
+// 跳到下一条记录的开头（格式错误时丢弃本行剩余部分）
+static void csv_skip_line(InputFile *in) {
+    const unsigned char *nl = (in->pos < in->size)
+                              ? (const unsigned char *)memchr(in->data + in->pos, '\n', in->size - in->pos) : NULL;
+    in->pos = (nl != NULL) ? (size_t)(nl - in->data) + 1 : in->size;
+}
+
+// 解析非负整数（只允许数字，不超过int范围），成功返回1
+static int csv_int(const char *text, int *value) {
+    long long v = 0;
+    if (*text == '\0') return 0;
+    for (; *text != '\0'; text++) {
+        if (*text < '0' || *text > '9') return 0;
+        v = v * 10 + (*text - '0');
+        if (v > 2147483647) return 0;
+    }
+    *value = (int)v;
+    return 1;
+}
+
+// 解析一条记录到book，格式正确返回1，否则返回0；解析位置都移到下一条记录开头
+static int csv_row(InputFile *in, BookNode *book) {
+    char stock[16], loaned[16], extra[2];
+    char *fields[CSV_COLUMNS] = {book->isbn, book->title, book->author, stock, loaned};
+    size_t sizes[CSV_COLUMNS] = {sizeof(book->isbn), sizeof(book->title), sizeof(book->author), sizeof(stock), sizeof(loaned)};
+    int n = 0, term = ',';
+    while (term == ',') {
+        term = (n < CSV_COLUMNS) ? csv_field(in, fields[n], sizes[n]) : csv_field(in, extra, sizeof(extra));
+        n++;
+    }
+    if (term == CSV_FIELD_QUOTE_ERROR) {
+        csv_skip_line(in);
+        return 0;
+    }
+    return n == CSV_COLUMNS && book->isbn[0] != '\0' &&
+           csv_int(stock, &book->stock) && csv_int(loaned, &book->loaned);
+}
+
+// 导入的有效记录：文件和每条记录的起始偏移
+typedef struct {
+    InputFile *in;
+    size_t *rows;
+} CsvRows;
+
+// 第二遍：从记下的偏移处重新解析第i条记录，直接填进节点
+static void csv_fill(BookNode *node, size_t i, void *ctx) {
+    const CsvRows *r = (const CsvRows *)ctx;
+    r->in->pos = r->rows[i];
+    csv_row(r->in, node);
+}
+
+// 6. 从CSV文件批量导入图书
+int import_from_csv(const char *filename, BookNode **head, CsvImportStats *stats) {
+    CsvImportStats local;
+    if (stats == NULL) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (filename == NULL || head == NULL) return -1;
+
+    double start = now_seconds();
+    InputFile in;
+    if (input_open(&in, filename) != 0) return -1;
+    if (in.size >= 3 && memcmp(in.data, "\xEF\xBB\xBF", 3) == 0) in.pos = 3; // 跳过UTF-8 BOM
+
+    // 第一遍：校验并记下每条有效记录的起始偏移
+    size_t cap = in.size / 64 + 16, count = 0;
+    size_t *rows = (size_t *)malloc(cap * sizeof(size_t));
+    size_t record = 0; // 记录编号（含表头，不含空行）
+    while (rows != NULL && in.pos < in.size) {
+        unsigned char c = in.data[in.pos];
+        if (c == '\n' || c == '\r') { // 空行
+            in.pos++;
+            continue;
+        }
+        size_t row_start = in.pos;
+        BookNode book;
+        int valid = csv_row(&in, &book);
+        record++;
+        if (record == 1 && strcmp(book.isbn, "ISBN") == 0) continue; // 表头
+        stats->rows++;
+        if (!valid) {
+            if (stats->invalid < CSV_MAX_WARNINGS) stats->invalid_records[stats->invalid] = record;
+            stats->invalid++;
+            continue;
+        }
+        if (count == cap) {
+            cap *= 2;
+            size_t *grown = (size_t *)realloc(rows, cap * sizeof(size_t));
+            if (grown == NULL) {
+                free(rows);
+                rows = NULL;
+                break;
+            }
+            rows = grown;
+        }
+        rows[count++] = row_start;
+    }
+
+    // 第二遍：批量插入，一遍哈希探测完成查重
+    int ret = -2;
+    if (rows != NULL) {
+        CsvRows ctx = {&in, rows};
+        if (book_list_push_batch(head, count, csv_fill, &ctx, &stats->imported) == 0) {
+            stats->duplicates = count - stats->imported;
+            ret = 0;
+        }
+    }
+    free(rows);
+    input_close(&in);
+    stats->seconds = now_seconds() - start;
+    return ret;
+}
+
+// 7. 导出图书到JSON文件
+int export_to_json(const char *filename, BookNode *head) {
+    // 普通导出：不写借阅日志，也不带检查点
+    return write_books_json(filename, head, JSON_STYLE_PRETTY);
+}
+/*
+ * 二进制目录快照（所有整数按小端存储）：
+ *   文件头88字节：magic "BKSN" | u32 版本(1) | u32 字节序标记0x01020304 | u32 记录大小(24)
+ *                | u64 图书数 | u64 字符串堆偏移 | u64 字符串堆大小 | u64 索引段偏移 | u64 索引槽位数
+ *                | u64 loan_seq | u64 log_base | u64 log_offset（借阅日志检查点）
+ *                | u32 索引排布版本(BOOK_INDEX_LAYOUT) | u32 标志（bit0=有检查点）
+ *   图书记录24字节×图书数（链表顺序）：u32 ISBN偏移 | u32 书名偏移 | u32 作者偏移 | i32 库存 | i32 已借出 | u32 保留
+ *   字符串堆：以'\0'结尾的字符串，偏移相对堆起点
+ *   ISBN索引段（8字节对齐）：BookIsbnSlot×槽位数，按book_isbn_home+线性探测排布，第i条记录的编号为n-1-i
+ * 加载时整个文件mmap进来，节点一次分配，索引段直接作为ISBN哈希表使用，不再逐本散列。
+ */
+#define SNAPSHOT_MAGIC "BKSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 88
+#define SNAPSHOT_RECORD_SIZE 24
+#define SNAPSHOT_FLAG_CHECKPOINT 0x1u
+
+// 8. 持久化图书到二进制快照
+int persist_books_snapshot(const char *filename, BookNode *head) {
+    if (filename == NULL || head == NULL) return -1;
+
+    // 第一遍：统计图书数和字符串堆大小
+    uint64_t count = 0, heap_size = 0;
+    for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+        count++;
+        heap_size += strlen(cur->isbn) + strlen(cur->title) + strlen(cur->author) + 3;
+    }
+    if (count > UINT32_MAX / 2 || heap_size > UINT32_MAX) return -1;
+
+    // 预建ISBN哈希表（装载因子不超过1/2，重复ISBN只登记链表中靠前的一本）
+    uint64_t capacity = 64;
+    while (capacity < count * 2) capacity *= 2;
+    BookIsbnSlot *slots = (BookIsbnSlot *)calloc((size_t)capacity, sizeof(BookIsbnSlot));
+    if (slots == NULL) return -1;
+
+    if (loan_log_flush() != 0) { // 同write_books_json：缓冲的记录写盘后检查点才可信
+        free(slots);
+        return -1;
+    }
+    int has_checkpoint = (loan_log_locate() == 0);
+
+    char tmp_name[512];
+    OutBuf *out = out_open_atomic(filename, tmp_name);
+    if (out == NULL) {
+        free(slots);
+        return -1;
+    }
+
+    uint64_t records_end = SNAPSHOT_HEADER_SIZE + count * SNAPSHOT_RECORD_SIZE;
+    uint64_t index_offset = (records_end + heap_size + 7) & ~(uint64_t)7;
+    unsigned char header[SNAPSHOT_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, SNAPSHOT_MAGIC, 4);
+    put_u32(header + 4, SNAPSHOT_VERSION);
+    put_u32(header + 8, LOANLOG_BOM);
+    put_u32(header + 12, SNAPSHOT_RECORD_SIZE);
+    put_u64(header + 16, count);
+    put_u64(header + 24, records_end);
+    put_u64(header + 32, heap_size);
+    put_u64(header + 40, index_offset);
+    put_u64(header + 48, capacity);
+    if (has_checkpoint) {
+        put_u64(header + 56, g_loan_log.next_seq);
+        put_u64(header + 64, g_loan_log.base_seq);
+        put_u64(header + 72, g_loan_log.end_offset);
+    }
+    put_u32(header + 80, BOOK_INDEX_LAYOUT);
+    put_u32(header + 84, has_checkpoint ? SNAPSHOT_FLAG_CHECKPOINT : 0);
+    out_write(out, (const char *)header, sizeof(header));
+
+    // 第二遍：写图书记录，同时登记哈希表
+    uint32_t offset = 0;
+    uint64_t i = 0;
+    for (BookNode *cur = head; cur != NULL; cur = cur->next, i++) {
+        unsigned char record[SNAPSHOT_RECORD_SIZE];
+        uint32_t isbn_len = (uint32_t)strlen(cur->isbn) + 1;
+        uint32_t title_len = (uint32_t)strlen(cur->title) + 1;
+        put_u32(record, offset);
+        put_u32(record + 4, offset + isbn_len);
+        put_u32(record + 8, offset + isbn_len + title_len);
+        put_u32(record + 12, (uint32_t)cur->stock);
+        put_u32(record + 16, (uint32_t)cur->loaned);
+        put_u32(record + 20, 0);
+        out_write(out, (const char *)record, sizeof(record));
+        offset += isbn_len + title_len + (uint32_t)strlen(cur->author) + 1;
+
+        IsbnKey key = isbn_pack(cur->isbn);
+        size_t pos = book_isbn_home(key, cur->isbn, (size_t)capacity);
+        int duplicate = 0;
+        while (slots[pos].id1 != 0) {
+            // 槽中的编号id1-1对应第count-id1条记录；非紧凑键需要回到链表比较字符串，这里只按键判重
+            if (key != ISBN_KEY_NONE && slots[pos].key == key) {
+                duplicate = 1;
+                break;
+            }
+            pos = (pos + 1) & (size_t)(capacity - 1);
+        }
+        if (!duplicate) {
+            slots[pos].key = key;
+            slots[pos].id1 = (uint32_t)(count - i); // 编号count-1-i，再+1
+        }
+    }
+
+    // 第三遍：写字符串堆
+    for (BookNode *cur = head; cur != NULL; cur = cur->next) {
+        out_write(out, cur->isbn, strlen(cur->isbn) + 1);
+        out_write(out, cur->title, strlen(cur->title) + 1);
+        out_write(out, cur->author, strlen(cur->author) + 1);
+    }
+    for (uint64_t pad = records_end + heap_size; pad < index_offset; pad++) out_char(out, '\0');
+
+    // 索引段
+    for (uint64_t pos = 0; pos < capacity; pos++) {
+        unsigned char slot[sizeof(BookIsbnSlot)];
+        put_u64(slot, slots[pos].key);
+        put_u32(slot + 8, slots[pos].id1);
+        put_u32(slot + 12, 0);
+        out_write(out, (const char *)slot, sizeof(slot));
+    }
+    free(slots);
+    return out_commit_atomic(out, tmp_name, filename);
+}
+
+// 快照加载时填写节点的上下文
+typedef struct {
+    const unsigned char *records; // 图书记录区
+    const char *heap;             // 字符串堆
+    uint32_t heap_size;           // 字符串堆大小
+} SnapshotReader;
+
+// 从字符串堆复制一个字符串到dst（越界或未结尾的截断）
+static void snapshot_copy(const SnapshotReader *r, uint32_t offset, char *dst, size_t size) {
+    size_t len = 0;
+    if (offset < r->heap_size) {
+        const char *src = r->heap + offset;
+        size_t limit = r->heap_size - offset;
+        if (limit > size - 1) limit = size - 1;
+        while (len < limit && src[len] != '\0') len++;
+        memcpy(dst, src, len);
+    }
+    dst[len] = '\0';
+}
+
+static void snapshot_fill(BookNode *node, size_t i, void *ctx) {
+    const SnapshotReader *r = (const SnapshotReader *)ctx;
+    const unsigned char *record = r->records + i * SNAPSHOT_RECORD_SIZE;
+    snapshot_copy(r, get_u32(record), node->isbn, sizeof(node->isbn));
+    snapshot_copy(r, get_u32(record + 4), node->title, sizeof(node->title));
+    snapshot_copy(r, get_u32(record + 8), node->author, sizeof(node->author));
+    node->stock = (int)get_u32(record + 12);
+    node->loaned = (int)get_u32(record + 16);
+}
+
+// 9. 从二进制快照加载图书（mmap整个文件，节点一次分配，直接采用预建的ISBN索引）
+BookNode *load_books_snapshot(const char *filename) {
+    InputFile in;
+    if (filename == NULL || input_open(&in, filename) != 0) return NULL;
+    if (in.size < SNAPSHOT_HEADER_SIZE) {
+        input_close(&in);
+        return NULL;
+    }
+    const unsigned char *map = in.data;
+    size_t size = in.size;
+
+    // 校验文件头和各段边界：每个偏移先与文件大小比较再做减法，各段都必须落在映射之内
+    BookNode *head = NULL;
+    uint64_t count = get_u64(map + 16);
+    uint64_t heap_offset = get_u64(map + 24), heap_size = get_u64(map + 32);
+    uint64_t index_offset = get_u64(map + 40), capacity = get_u64(map + 48);
+    int valid = memcmp(map, SNAPSHOT_MAGIC, 4) == 0 && get_u32(map + 4) == SNAPSHOT_VERSION &&
+                get_u32(map + 8) == LOANLOG_BOM && get_u32(map + 12) == SNAPSHOT_RECORD_SIZE &&
+                // 图书记录区
+                count > 0 && count <= UINT32_MAX / 2 &&
+                count <= (size - SNAPSHOT_HEADER_SIZE) / SNAPSHOT_RECORD_SIZE &&
+                heap_offset == SNAPSHOT_HEADER_SIZE + count * SNAPSHOT_RECORD_SIZE &&
+                // 字符串堆
+                heap_size <= UINT32_MAX && heap_size <= size - heap_offset &&
+                // 索引段
+                index_offset <= size && index_offset >= heap_offset + heap_size && index_offset % 8 == 0 &&
+                capacity <= (size - index_offset) / sizeof(BookIsbnSlot);
+    if (valid) {
+        SnapshotReader reader = {map + SNAPSHOT_HEADER_SIZE, (const char *)map + heap_offset, (uint32_t)heap_size};
+        // 索引段按小端布局直接映射，只有小端主机、排布版本一致时才能直接采用
+        uint32_t probe = 1;
+        int little_endian = (*(const unsigned char *)&probe == 1);
+        const BookIsbnSlot *slots = (little_endian && get_u32(map + 80) == BOOK_INDEX_LAYOUT)
+                                    ? (const BookIsbnSlot *)(map + index_offset) : NULL;
+        head = book_list_build((size_t)count, snapshot_fill, &reader, slots, (size_t)capacity);
+    }
+
+    if (head != NULL) {
+        // 读取检查点（没有检查点时借阅日志从头回放）
+        memset(&g_snapshot, 0, sizeof(g_snapshot));
+        if (get_u32(map + 84) & SNAPSHOT_FLAG_CHECKPOINT) {
+            g_snapshot.seq = get_u64(map + 56);
+            g_snapshot.base = get_u64(map + 64);
+            g_snapshot.offset = get_u64(map + 72);
+        }
+    } else {
+        fprintf(stderr, "警告：快照 %s 格式不对或已损坏，未加载\n", filename);
+    }
+    input_close(&in);
+    return head;
+}
@@ -3,23 +3,112 @@
 
 #include "data.h"
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LOG_COMPACT_MIN_RECORDS 4096 // 退出时自动压缩日志的阈值（快照已包含的记录条数）
+
+/**
+ * @brief 批量借阅中的一条
+ */
+typedef struct {
+    const char *isbn; // ISBN编号
+    int quantity;     // 借阅数量
+} LoanEntry;
+
 /**
  * @brief 记录借阅操作到二进制文件
  *
+ * 日志文件保持打开，记录先进入进程内缓冲区，满LOG_FLUSH_RECORDS条时写盘；
+ * 缓冲区中最早的记录等待超过LOG_FLUSH_INTERVAL秒时，由下一条记录或后台线程（每秒检查一次）写盘；
+ * 程序退出时写出剩余记录。写盘失败的记录留在缓冲区，下次写盘时重试。
+ *
  * @param isbn ISBN编号
  * @param quantity 借阅数量
+ * @return int 0=已记录（可能仍在缓冲区中）, -1=参数非法、日志无法打开或缓冲区已满且写盘失败（未记录，序号不变）
+ */
+int log_loan(const char *isbn, int quantity);
+
+/**
+ * @brief 批量记录借阅操作，整批记录一次写入
+ *
+ * @param entries 借阅记录数组（isbn为NULL或空串、数量<=0的条目被跳过）
+ * @param count 记录数
+ * @return int 0=成功, -1=失败（整批未记录，序号不变）
+ */
+int log_loan_batch(const LoanEntry *entries, size_t count);
+
+/**
+ * @brief 把缓冲区中的借阅记录立即写盘
+ *
+ * @return int 0=成功, -1=失败（记录留在缓冲区，下次写盘时重试）
+ */
+int loan_log_flush(void);
+
+/**
+ * @brief 写盘并关闭借阅日志（程序退出前调用，也已注册到atexit）
+ *
+ * 同时停止后台写盘线程。仍写不出去的记录被丢弃，并向stderr报告条数。
+ */
+void loan_log_close(void);
+
+/**
+ * @brief 当前借阅日志序号（已记录的借阅总数，含已压缩掉的记录）
+ *
+ * persist_books_json把这个序号作为检查点写入快照。
+ *
+ * @return uint64_t 下一条借阅记录的序号
  */
-void log_loan(const char *isbn, int quantity);
+uint64_t loan_log_seq(void);
+
+/**
+ * @brief 压缩借阅日志，丢弃序号小于upto_seq的记录
+ *
+ * 这些记录必须已包含在落盘的快照中（通常传入保存快照前的loan_log_seq()）。
+ * 日志写临时文件后改名覆盖，中途失败原日志不变；缓冲的记录写盘失败时不压缩。
+ *
+ * @param upto_seq 检查点序号
+ * @param min_records 可丢弃的记录少于此数时不压缩
+ * @return long 丢弃的记录数，-1=失败
+ */
+long compact_loan_log(uint64_t upto_seq, uint64_t min_records);
 
 /**
  * @brief 从二进制文件加载历史记录
  *
+ * 只回放最近一次load_books_from_json读到的检查点之后的记录，
+ * 检查点之前的借阅已经包含在快照的库存/已借出数量中。
+ * 回放的提示、警告和吞吐量写到log（批处理模式传stderr，不混入命令输出）。
+ *
  * @param head 链表头指针
+ * @param log 提示和警告的输出流
  */
-void load_loans(BookNode *head);
+void load_loans(BookNode *head, FILE *log);
 
 /**
- * @brief 持久化书籍信息到JSON文件（系统内部使用）
+ * @brief 调整借阅日志并行回放的参数（默认按CPU数、待回放部分不小于8MB时启用）
+ *
+ * 并行回放的结果与顺序回放相同；主要供测试在单核机器上强制走多线程、多轮次的路径。
+ *
+ * @param threads 线程数，0表示按在线CPU数，1表示总是顺序回放
+ * @param min_bytes 待回放部分至少这么大才并行回放
+ * @param chunk_blocks 每个读取线程每轮解析的记录块数，0表示默认值
+ */
+void loan_replay_config(int threads, size_t min_bytes, size_t chunk_blocks);
+
+/**
+ * @brief 测试用：让并行回放的第round轮按读取线程内存不足处理（这一轮不应用，其余记录顺序回放）
+ *
+ * @param round 轮次（从1开始），0表示不模拟
+ */
+void loan_replay_fail_round(int round);
+
+/**
+ * @brief 持久化书籍信息到JSON文件（旧版本数据文件使用；导出用export_to_json）
+ *
+ * metadata中写入借阅日志检查点（loan_seq/log_base/log_offset），
+ * 表示快照已包含的借阅记录；写入前先把缓冲的借阅记录写盘，写盘失败时不保存。
  *
  * @param filename 输出文件名
  * @param head 链表头指针
@@ -27,28 +116,123 @@ void load_loans(BookNode *head);
  */
 int persist_books_json(const char *filename, BookNode *head);
 
+/**
+ * @brief JSON输出格式
+ */
+typedef enum {
+    JSON_STYLE_PRETTY,  // 缩进换行，便于人工查看
+    JSON_STYLE_COMPACT  // 不加空白，文件最小
+} JsonStyle;
+
+/**
+ * @brief 流式写出书籍信息到JSON文件
+ *
+ * 边遍历链表边经固定大小的缓冲区写盘，不构建cJSON树，内存占用与图书数量无关。
+ * 用于导出：只写图书数据，不把缓冲的借阅记录写盘，也不带借阅日志检查点。先写filename.tmp并fsync，
+ * 再改名覆盖filename，中途失败或崩溃时原文件保持不变。
+ *
+ * @param filename 输出文件名
+ * @param head 链表头指针
+ * @param style 输出格式
+ * @return int 0=成功, -1=失败
+ */
+int write_books_json(const char *filename, BookNode *head, JsonStyle style);
+
 /**
  * @brief 从JSON文件恢复书籍信息
  *
+ * 同时记下快照中的借阅日志检查点，供随后的load_loans使用；
+ * 只认persist_books_json写出的文件（metadata.kind为"library"）中的检查点，导出文件的检查点忽略。
+ *
  * @param filename 输入文件名
  * @return BookNode* 恢复后的链表头指针（NULL表示失败）
  */
 BookNode *load_books_from_json(const char *filename);
 
+/**
+ * @brief 持久化书籍信息到二进制快照（系统内部使用）
+ *
+ * 文件由文件头、定长图书记录、字符串堆和预建的ISBN索引段组成（格式见store.c），
+ * 同样写入借阅日志检查点，并以临时文件+fsync+改名的方式原子替换。
+ *
+ * @param filename 输出文件名
+ * @param head 链表头指针
+ * @return int 0=成功, -1=失败
+ */
+int persist_books_snapshot(const char *filename, BookNode *head);
+
+/**
+ * @brief 从二进制快照恢复书籍信息
+ *
+ * mmap整个文件，节点一次分配，索引段直接作为ISBN哈希表使用，三元组索引推迟到第一次搜索时建立。
+ * 同时记下快照中的借阅日志检查点，供随后的load_loans使用。
+ *
+ * @param filename 输入文件名
+ * @return BookNode* 恢复后的链表头指针（NULL表示文件不存在或格式不对）
+ */
+BookNode *load_books_snapshot(const char *filename);
+
+/**
+ * @brief 把图书以CSV格式写到已打开的流（文件、管道或stdout）
+ *
+ * 首行为表头ISBN,书名,作者,库存,已借出。含逗号、双引号或换行的字段加双引号，
+ * 其中的双引号写两遍（RFC 4180），import_from_csv可原样读回。经固定大小的缓冲区整块写出。
+ * 不关闭fp。
+ *
+ * @param fp 输出流
+ * @param head 链表头指针
+ * @return int 0=成功, -1=写入失败
+ */
+int write_books_csv(FILE *fp, BookNode *head);
+
 /**
  * @brief 导出图书数据到CSV文件（外部使用）
  *
+ * 不打印提示信息，由调用方根据返回值回复。
+ *
  * @param filename 输出文件名
  * @param head 链表头指针
+ * @return int 0=成功, -1=链表为空、文件无法创建或写入失败
+ */
+int export_to_csv(const char *filename, BookNode *head);
+
+#define CSV_MAX_WARNINGS 10 // CsvImportStats最多记下的格式错误记录数
+
+/**
+ * @brief CSV导入的统计结果
+ */
+typedef struct {
+    size_t rows;       // 数据记录数（不含表头和空行）
+    size_t imported;   // 新增的图书数
+    size_t duplicates; // ISBN已存在或文件内重复而跳过的记录数
+    size_t invalid;    // 格式不对而跳过的记录数
+    size_t invalid_records[CSV_MAX_WARNINGS]; // 前min(invalid, CSV_MAX_WARNINGS)条格式不对的记录编号（从1开始，含表头）
+    double seconds;    // 耗时（秒）
+} CsvImportStats;
+
+/**
+ * @brief 从CSV文件批量导入图书
+ *
+ * 列顺序与export_to_csv相同（ISBN,书名,作者,库存,已借出），按RFC 4180处理引号字段，
+ * 首行为表头时跳过。文件只读映射后原地解析，整批经book_list_push_batch插入，
+ * 查重只做一遍哈希探测；格式不对的记录跳过并记入stats。不打印提示信息，由调用方根据结果回复。
+ *
+ * @param filename 输入文件名
+ * @param head 链表头指针的地址
+ * @param stats 输出统计结果，可为NULL
+ * @return int 0=成功, -1=文件无法读取, -2=内存不足（失败时链表不变）
  */
-void export_to_csv(const char *filename, BookNode *head);
+int import_from_csv(const char *filename, BookNode **head, CsvImportStats *stats);
 
 /**
  * @brief 导出图书数据到JSON文件（外部使用）
  *
+ * 即JSON_STYLE_PRETTY格式的write_books_json，不带借阅日志检查点。
+ *
  * @param filename 输出文件名
  * @param head 链表头指针
+ * @return int 0=成功, -1=链表为空或写入失败
  */
-void export_to_json(const char *filename, BookNode *head);
+int export_to_json(const char *filename, BookNode *head);
 
 #endif // LIBRARY_STORE_H
\ No newline at end of file
@@ -1,6 +1,25 @@
 // test_data.c - 专门测试data模块的main函数
 #include "data.h"
+#include "logic.h"
 #include <stdio.h>
+#include <string.h>
+
+// 搜索回调：统计匹配数量
+static void count_hit(BookNode *book, void *ctx) {
+    (void)book;
+    (*(int *)ctx)++;
+}
+
+// 搜索回调：把匹配图书的ISBN依次拼接到缓冲区
+static void append_isbn(BookNode *book, void *ctx) {
+    strcat((char *)ctx, book->isbn);
+    strcat((char *)ctx, " ");
+}
+
+// 批量插入回调：复制第i行
+static void copy_row(BookNode *node, size_t i, void *ctx) {
+    *node = ((const BookNode *)ctx)[i];
+}
 
 int main() {
     // 1. 初始化主链表头指针（必须置NULL）
@@ -44,7 +63,115 @@ int main() {
     // 5. 销毁结果链表（用完立即销毁，避免泄漏）
     destroy_list(&result);
 
-    // 6. 销毁主链表（程序退出前）
+    // 6. 测试ISBN索引（add_book1构建的链表自带哈希索引）
+    printf("\n【测试ISBN索引】\n");
+    BookNode *indexed = NULL;
+    add_book1(&indexed, "三体", "刘慈欣", "9787532781234", 5, 0);
+    add_book1(&indexed, "流浪地球", "刘慈欣", "9787532782345", 2, 1);
+    add_book1(&indexed, "三体（重复）", "刘慈欣", "9787532781234", 10, 0); // 应被拒绝
+    printf("索引存在：%s\n", book_index_of(indexed) ? "是" : "否");
+    found = search_by_isbn(indexed, "9787532781234");
+    printf("查找9787532781234：%s\n", found ? found->title : "未找到");
+    found = search_by_isbn(indexed, "9787532789999");
+    printf("查找9787532789999：%s\n", found ? found->title : "未找到");
+    // 三元组索引：中文关键词（"刘慈欣"为9个UTF-8字节）与短关键词（退回遍历）
+    const char *keywords[] = {"刘慈欣", "地球", "体", "Python"};
+    for (int k = 0; k < 4; k++) {
+        int hit_count = 0;
+        search_by_keyword_each(indexed, keywords[k], count_hit, &hit_count);
+        printf("关键词\"%s\"匹配%d本\n", keywords[k], hit_count);
+    }
+    // 删除后节点回收：新书应复用被删除节点的内存
+    BookNode *deleted = search_by_isbn(indexed, "9787532782345");
+    printf("删除9787532782345：%d\n", delete_book(&indexed, "9787532782345"));
+    printf("删除后查找：%s\n", search_by_isbn(indexed, "9787532782345") ? "仍存在" : "未找到");
+    add_book1(&indexed, "球状闪电", "刘慈欣", "9787536692930", 4, 0);
+    printf("新节点复用已删除节点：%s\n", search_by_isbn(indexed, "9787536692930") == deleted ? "是" : "否");
+    // 修改计数：同样的库存/借阅量不算修改，变化后递增
+    uint64_t generation = book_list_generation(indexed);
+    book_set_counts(indexed, indexed, indexed->stock, indexed->loaned);
+    printf("未改变数值时修改计数不变：%s\n", book_list_generation(indexed) == generation ? "是" : "否");
+    book_set_counts(indexed, indexed, indexed->stock - 1, indexed->loaned + 1);
+    printf("借阅后修改计数递增：%s\n", book_list_generation(indexed) > generation ? "是" : "否");
+    destroy_list(&indexed);
+
+    // 6.1 批量插入：已存在和批内重复的ISBN被跳过，插入后索引和搜索正常
+    printf("\n【测试批量插入】\n");
+    BookNode *batch = NULL;
+    add_book1(&batch, "三体", "刘慈欣", "9787532781234", 5, 0);
+    static const BookNode rows[] = {
+        {"9787532781234", "重复的三体", "某人", 1, 0, NULL},
+        {"9787020002207", "红楼梦", "曹雪芹", 3, 1, NULL},
+        {"9787020002207", "批内重复", "某人", 1, 0, NULL},
+        {"753278123X", "白夜行", "东野圭吾", 2, 0, NULL},
+    };
+    size_t added = 0;
+    int batch_ret = book_list_push_batch(&batch, 4, copy_row, (void *)rows, &added);
+    printf("book_list_push_batch 返回 %d，插入 %zu 本\n", batch_ret, added);
+    for (BookNode *cur = batch; cur != NULL; cur = cur->next) {
+        printf("  %s - %s（库存：%d，已借出：%d）\n", cur->isbn, cur->title, cur->stock, cur->loaned);
+    }
+    BookNode *dup = search_by_isbn(batch, "9787020002207");
+    printf("批内重复保留先出现的：%s\n", dup ? dup->title : "未找到");
+    int batch_hits = 0;
+    search_by_keyword_each(batch, "白夜行", count_hit, &batch_hits);
+    printf("批量插入后关键词\"白夜行\"匹配%d本\n", batch_hits);
+    destroy_list(&batch);
+
+    // 6.2 书名、作者都不足3字节时三元组表从未分配：长关键词应无结果（不能崩溃）
+    printf("\n【测试只有短书名/作者的三元组索引】\n");
+    BookNode *shorts = NULL;
+    add_book1(&shorts, "Go", "Li", "9781", 5, 0);
+    int short_hits = 0;
+    search_by_keyword_each(shorts, "abc", count_hit, &short_hits);
+    printf("关键词\"abc\"匹配%d本\n", short_hits);
+    short_hits = 0;
+    search_by_keyword_each(shorts, "Go", count_hit, &short_hits);
+    printf("关键词\"Go\"匹配%d本\n", short_hits);
+    destroy_list(&shorts);
+
+    // 6.3 搜索结果顺序：长关键词（走三元组索引）与短关键词（遍历）都按链表顺序，排序后跟随新顺序
+    printf("\n【测试搜索结果顺序】\n");
+    BookNode *ordered = NULL;
+    add_book1(&ordered, "Data Book A", "Ann", "9780000000001", 3, 0);
+    add_book1(&ordered, "Data Book B", "Bob", "9780000000002", 1, 0);
+    add_book1(&ordered, "Data Book C", "Cid", "9780000000003", 2, 0);
+    char by_gram[128] = "", by_scan[128] = "";
+    search_by_keyword_each(ordered, "Data", append_isbn, by_gram);
+    search_by_keyword_each(ordered, "D", append_isbn, by_scan);
+    printf("录入后：长关键词 %s| 短关键词 %s| %s\n", by_gram, by_scan, strcmp(by_gram, by_scan) == 0 ? "一致" : "不一致");
+    sort_by_stock(&ordered);
+    by_gram[0] = by_scan[0] = '\0';
+    search_by_keyword_each(ordered, "Data", append_isbn, by_gram);
+    search_by_keyword_each(ordered, "D", append_isbn, by_scan);
+    printf("排序后：长关键词 %s| 短关键词 %s| %s\n", by_gram, by_scan, strcmp(by_gram, by_scan) == 0 ? "一致" : "不一致");
+    add_book1(&ordered, "Data Book D", "Dan", "9780000000004", 9, 0);
+    by_gram[0] = by_scan[0] = '\0';
+    search_by_keyword_each(ordered, "Data", append_isbn, by_gram);
+    search_by_keyword_each(ordered, "D", append_isbn, by_scan);
+    printf("排序后再录入：长关键词 %s| 短关键词 %s| %s\n", by_gram, by_scan, strcmp(by_gram, by_scan) == 0 ? "一致" : "不一致");
+    destroy_list(&ordered);
+
+    // 6.4 批量建表（快照加载）遇到重复ISBN视为数据损坏，返回NULL
+    printf("\n【测试批量建表拒绝重复ISBN】\n");
+    static const BookNode build_rows[] = {
+        {"9787020002207", "红楼梦", "曹雪芹", 3, 1, NULL},
+        {"9787532781234", "三体", "刘慈欣", 5, 0, NULL},
+        {"9787020002207", "红楼梦（重复）", "曹雪芹", 1, 0, NULL},
+    };
+    BookNode *built = book_list_build(2, copy_row, (void *)build_rows, NULL, 0);
+    printf("无重复时建表：%s\n", built != NULL ? "成功" : "失败");
+    destroy_list(&built);
+    built = book_list_build(3, copy_row, (void *)build_rows, NULL, 0);
+    printf("有重复时建表：%s\n", built != NULL ? "成功" : "失败（已拒绝）");
+    destroy_list(&built);
+
+    // 7. 测试紧凑ISBN键
+    printf("\n【测试紧凑ISBN键】\n");
+    printf("\"0012\"与\"12\"键不同：%s\n", isbn_pack("0012") != isbn_pack("12") ? "是" : "否");
+    printf("\"753278123X\"退回字符串路径：%s\n", isbn_pack("753278123X") == ISBN_KEY_NONE ? "是" : "否");
+
+    // 8. 销毁主链表（程序退出前）
     printf("\n【销毁主链表】\n");
     destroy_list(&main_head);
 
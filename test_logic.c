@@ -49,6 +49,35 @@ void free_book_list(BookNode** head) {
     *head = NULL;
 }
 
+// 辅助函数：遍历链表找借阅量最高的图书（相同时取第一本，与generate_report遍历链表的结果一致）
+BookNode* first_most_loaned(BookNode* head) {
+    BookNode* best = head;
+    for (BookNode* cur = head; cur != NULL; cur = cur->next) {
+        if (cur->loaned > best->loaned) best = cur;
+    }
+    return best;
+}
+
+// 辅助函数：先求Top-K，再稳定排序，检查Top-K是否就是排序后的前k本（排序后链表保持排好的顺序）
+int top_matches_sort(BookNode** head, int sort_type, int k) {
+    BookNode* top[8];
+    int n = top_k_books(*head, sort_type, k, top);
+    if (sort_type == 0) sort_by_stock(head); else sort_by_loan(head);
+    BookNode* cur = *head;
+    for (int i = 0; i < n; i++, cur = cur->next) {
+        if (cur != top[i]) return 0;
+    }
+    return n == k;
+}
+
+// 辅助函数：借阅量相同的图书是否仍按库存升序排列（先按库存、再按借阅量排序后检查）
+int loan_ties_keep_stock_order(BookNode* head) {
+    for (BookNode* cur = head; cur != NULL && cur->next != NULL; cur = cur->next) {
+        if (cur->loaned == cur->next->loaned && cur->stock > cur->next->stock) return 0;
+    }
+    return 1;
+}
+
 // 主测试函数
 int main() {
     // 1. 创建测试链表
@@ -64,12 +93,12 @@ int main() {
     print_book_list(head);
 
     // 3. 测试按库存升序排序
-    sort_by_stock(&head);
+    printf("\nsort_by_stock 返回 %d", sort_by_stock(&head));
     printf("\n【按库存升序排序后】");
     print_book_list(head);
 
     // 4. 测试按借阅量降序排序
-    sort_by_loan(&head);
+    printf("\nsort_by_loan 返回 %d", sort_by_loan(&head));
     printf("\n【按借阅量降序排序后】");
     print_book_list(head);
 
@@ -79,6 +108,103 @@ int main() {
 
     // 6. 释放内存
     free_book_list(&head);
+    printf("空链表排序返回 %d（应为-1）\n", sort_by_stock(&head));
+
+    // 7. 用add_book1建表（带索引和列存储），排序与报告走列扫描路径
+    printf("\n【列存储路径】");
+    BookNode* indexed = NULL;
+    add_book1(&indexed, "算法导论", "Thomas H. Cormen", "9787111407010", 8, 56);
+    add_book1(&indexed, "数据结构", "严蔚敏", "9787302147510", 3, 120);
+    add_book1(&indexed, "C语言程序设计", "谭浩强", "9787302224281", 10, 89);
+    // 通过book_set_counts修改数值，保持列与节点同步
+    BookNode* book = search_by_isbn(indexed, "9787111407010");
+    book_set_counts(indexed, book, book->stock - 2, book->loaned + 100);
+    sort_by_stock(&indexed);
+    print_book_list(indexed);
+    sort_by_loan(&indexed);
+    print_book_list(indexed);
+    generate_report(indexed);
+    // Top-K：借阅最多的2本、库存最少的2本，链表顺序不变
+    BookNode* top[2];
+    int n = top_k_books(indexed, 1, 2, top);
+    for (int i = 0; i < n; i++) printf("借阅Top%d：《%s》 %d\n", i + 1, top[i]->title, top[i]->loaned);
+    n = top_k_books(indexed, 0, 2, top);
+    for (int i = 0; i < n; i++) printf("库存最少%d：《%s》 %d\n", i + 1, top[i]->title, top[i]->stock);
+    print_book_list(indexed);
+    // 删除后再插入：排序数组按存活数分配，排序后图书一本不少
+    delete_book(&indexed, "9787302147510");
+    add_book1(&indexed, "Python编程", "Mark Lutz", "9787115487827", 5, 78);
+    add_book1(&indexed, "深入理解计算机系统", "Randal E. Bryant", "9787111544937", 4, 95);
+    sort_by_loan(&indexed);
+    int books = 0;
+    for (BookNode* cur = indexed; cur != NULL; cur = cur->next) books++;
+    printf("删除1本、新增2本后排序：链表中%d本（应为4本）\n", books);
+    destroy_list(&indexed);
+
+    // 8. 连续排序：按借阅量排序是稳定的，借阅量相同的图书保持按库存排好的顺序（两种链表结果一致）
+    // 库存与录入顺序相反，若按录入顺序处理相同的键就会排错
+    printf("\n【先按库存、再按借阅量排序】\n");
+    head = create_book("图书A", "作者A", "9780000000001", 1, 50);
+    head->next = create_book("图书B", "作者B", "9780000000002", 2, 50);
+    head->next->next = create_book("图书C", "作者C", "9780000000003", 3, 80);
+    head->next->next->next = create_book("图书D", "作者D", "9780000000004", 4, 50);
+    add_book1(&indexed, "图书A", "作者A", "9780000000001", 1, 50);
+    add_book1(&indexed, "图书B", "作者B", "9780000000002", 2, 50);
+    add_book1(&indexed, "图书C", "作者C", "9780000000003", 3, 80);
+    add_book1(&indexed, "图书D", "作者D", "9780000000004", 4, 50);
+    sort_by_stock(&head);
+    sort_by_loan(&head);
+    sort_by_stock(&indexed);
+    sort_by_loan(&indexed);
+    printf("手动链表：%s\n", loan_ties_keep_stock_order(head) ? "稳定" : "不稳定");
+    printf("索引链表：%s\n", loan_ties_keep_stock_order(indexed) ? "稳定" : "不稳定");
+    int same = 1;
+    BookNode* a = head;
+    BookNode* b = indexed;
+    for (; a != NULL && b != NULL; a = a->next, b = b->next) {
+        if (strcmp(a->isbn, b->isbn) != 0) same = 0;
+    }
+    printf("两种链表顺序%s\n", (same && a == NULL && b == NULL) ? "一致" : "不一致");
+    free_book_list(&head);
+    destroy_list(&indexed);
+
+    // 9. 借阅量相同时最热门图书取链表中靠前的一本，排序改变链表顺序后同样如此
+    printf("\n【借阅量相同时的最热门图书】\n");
+    add_book1(&indexed, "图书A", "作者A", "9780000000001", 1, 50);
+    add_book1(&indexed, "图书B", "作者B", "9780000000002", 2, 50);
+    add_book1(&indexed, "图书C", "作者C", "9780000000003", 3, 20);
+    BookAggregates agg;
+    book_aggregates(indexed, &agg);
+    printf("录入后：《%s》（遍历链表为《%s》）\n", agg.hottest->title, first_most_loaned(indexed)->title);
+    sort_by_stock(&indexed);
+    book_aggregates(indexed, &agg);
+    printf("按库存排序后：《%s》（遍历链表为《%s》）\n", agg.hottest->title, first_most_loaned(indexed)->title);
+    destroy_list(&indexed);
+
+    // 10. Top-K在键相同时按链表顺序取，与稳定排序后的前k本一致（先按库存、再在新顺序上按借阅量）
+    printf("\n【Top-K与排序结果对比】\n");
+    head = create_book("图书A", "作者A", "9780000000001", 3, 50);
+    head->next = create_book("图书B", "作者B", "9780000000002", 3, 80);
+    head->next->next = create_book("图书C", "作者C", "9780000000003", 1, 50);
+    head->next->next->next = create_book("图书D", "作者D", "9780000000004", 3, 50);
+    head->next->next->next->next = create_book("图书E", "作者E", "9780000000005", 2, 80);
+    add_book1(&indexed, "图书A", "作者A", "9780000000001", 3, 50);
+    add_book1(&indexed, "图书B", "作者B", "9780000000002", 3, 80);
+    add_book1(&indexed, "图书C", "作者C", "9780000000003", 1, 50);
+    add_book1(&indexed, "图书D", "作者D", "9780000000004", 3, 50);
+    add_book1(&indexed, "图书E", "作者E", "9780000000005", 2, 80);
+    int stock_ok = top_matches_sort(&head, 0, 3);
+    int loan_ok = top_matches_sort(&head, 1, 3);
+    printf("手动链表：库存Top3%s，借阅Top3%s\n", stock_ok ? "一致" : "不一致", loan_ok ? "一致" : "不一致");
+    stock_ok = top_matches_sort(&indexed, 0, 3);
+    loan_ok = top_matches_sort(&indexed, 1, 3);
+    printf("索引链表：库存Top3%s，借阅Top3%s\n", stock_ok ? "一致" : "不一致", loan_ok ? "一致" : "不一致");
+    // k远大于图书总数：按总数分配，不会申请巨大的内存
+    BookNode* all[8];
+    printf("手动链表 top_k_books(k=2000000000) 返回 %d（应为5）\n", top_k_books(head, 1, 2000000000, all));
+    printf("图书数 %zu / %zu（应为5 / 5）\n", count_books(head), count_books(indexed));
+    free_book_list(&head);
+    destroy_list(&indexed);
     printf("\n测试完成，内存已释放！\n");
 
     return 0;
@@ -0,0 +1,179 @@
+// test_server.c
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "data.h"
+#include "logic.h"
+#include "server.h"
+#include "store.h"
+
+#define TEST_SOCKET "test_server.sock"
+
+/* 测试用的命令执行函数：只实现add/isbn/export，回复和状态码与main.c的run_command一致 */
+static int test_run(void *ctx, const char *line, FILE *out) {
+    BookNode **head = (BookNode **)ctx;
+    char isbn[20], title[100], author[50], format[5], filename[64];
+    int stock;
+    if (sscanf(line, "add %19s %99s %49s %d", isbn, title, author, &stock) == 4) {
+        if (search_by_isbn(*head, isbn) != NULL) {
+            fprintf(out, "Error: ISBN %s already exists.\n", isbn);
+            return 3;
+        }
+        add_book1(head, title, author, isbn, stock, 0);
+        fprintf(out, "Book added successfully.\n");
+        return 0;
+    }
+    if (sscanf(line, "isbn %19s", isbn) == 1) {
+        BookNode *book = search_by_isbn(*head, isbn);
+        if (book == NULL) {
+            fprintf(out, "Book not found.\n");
+            return 2;
+        }
+        fprintf(out, "Found book: %s\n", book->title);
+        return 0;
+    }
+    if (sscanf(line, "export %4s %63s", format, filename) == 2 && strcmp(format, "csv") == 0) {
+        if (export_to_csv(filename, *head) != 0) {
+            fprintf(out, "Error: failed to write %s\n", filename);
+            return 4;
+        }
+        fprintf(out, "Data exported to %s\n", filename);
+        return 0;
+    }
+    fprintf(out, "Unknown command.\n");
+    return 1;
+}
+
+static int test_read_only(const char *line) {
+    return strncmp(line, "isbn ", 5) == 0;
+}
+
+static void *server_thread(void *arg) {
+    static int ret;
+    ret = server_run((const ServerConfig *)arg);
+    return &ret;
+}
+
+/* 连接服务器（服务器线程刚启动时套接字可能还没有监听，重试最多5秒） */
+static int connect_server(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, TEST_SOCKET);
+    for (int i = 0; i < 500; i++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        struct timespec ts = {0, 10 * 1000 * 1000};
+        nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+/* 读取一条命令的回复：输出行拼到text，返回结束行"= <状态码>"中的状态码，连接关闭返回-1 */
+static int read_reply(FILE *in, char *text, size_t size) {
+    char line[SERVER_LINE_MAX];
+    text[0] = '\0';
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (line[0] == '=' && line[1] == ' ') return atoi(line + 2);
+        strncat(text, line, size - strlen(text) - 1);
+    }
+    return -1;
+}
+
+static int g_failures = 0;
+
+/* 发送一行（或多行）命令，检查回复的状态码和输出 */
+static void expect(int fd, FILE *in, const char *send_text, int status, const char *contains) {
+    char text[4096];
+    if (send_text != NULL && write(fd, send_text, strlen(send_text)) != (ssize_t)strlen(send_text)) {
+        printf("发送失败：%s", send_text);
+        g_failures++;
+        return;
+    }
+    int got = read_reply(in, text, sizeof(text));
+    int ok = (got == status) && (contains == NULL || strstr(text, contains) != NULL);
+    printf("%s 状态 %d（应为%d）输出：%s", ok ? "[通过]" : "[失败]", got, status, text[0] ? text : "（无）\n");
+    if (!ok) g_failures++;
+}
+
+int main(void) {
+    BookNode *head = NULL;
+    ServerConfig config = {0};
+    config.unix_path = TEST_SOCKET;
+    config.workers = 2;
+    config.run = test_run;
+    config.read_only = test_read_only;
+    config.ctx = &head;
+
+    // 1) 在后台线程启动服务器，监听临时Unix域套接字
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, server_thread, &config) != 0) {
+        fprintf(stderr, "无法创建服务器线程\n");
+        return 1;
+    }
+    int fd = connect_server();
+    if (fd < 0) {
+        fprintf(stderr, "无法连接 %s\n", TEST_SOCKET);
+        return 1;
+    }
+    FILE *in = fdopen(dup(fd), "r");
+
+    // 套接字文件只有服务器用户能连接
+    struct stat st;
+    int private_mode = (stat(TEST_SOCKET, &st) == 0 && (st.st_mode & 0777) == 0600);
+    printf("%s 套接字文件权限 %03o（应为600）\n", private_mode ? "[通过]" : "[失败]", (unsigned)(st.st_mode & 0777));
+    if (!private_mode) g_failures++;
+
+    // 2) 每条命令的回复以"= <状态码>"结束
+    printf("\n>> add / isbn 的回复格式\n");
+    expect(fd, in, "add 9787000000001 Book_One Alice 5\n", 0, "Book added");
+    expect(fd, in, "add 9787000000001 Book_One Alice 5\n", 3, "already exists");
+    expect(fd, in, "isbn 9787000000001\n", 0, "Book_One");
+    expect(fd, in, "isbn 9787999999999\n", 2, "not found");
+
+    // 3) 一次发出多条命令（含空行和注释），回复按顺序逐条返回；CRLF结尾同样可以
+    printf("\n>> 连续发送多条命令\n");
+    expect(fd, in, "add 9787000000002 Book_Two Bob 3\r\n\n# 注释\nisbn 9787000000002\n", 0, "Book added");
+    expect(fd, in, NULL, 0, "Book_Two");
+
+    // 4) 命令失败的状态码和提示发回客户端（不写到服务器的stdout）
+    printf("\n>> 失败的命令\n");
+    expect(fd, in, "export csv no_such_dir/books.csv\n", 4, "failed to write");
+    char long_line[SERVER_LINE_MAX + 16];
+    memset(long_line, 'x', sizeof(long_line) - 2);
+    long_line[sizeof(long_line) - 2] = '\n';
+    long_line[sizeof(long_line) - 1] = '\0';
+    expect(fd, in, long_line, 1, "Line too long");
+    expect(fd, in, "isbn 9787000000001\n", 0, "Book_One"); // 超长行之后连接仍可用
+
+    // 5) exit关闭连接
+    printf("\n>> exit\n");
+    char text[256];
+    int closed = (write(fd, "exit\n", 5) == 5 && read_reply(in, text, sizeof(text)) == -1);
+    printf("%s exit后服务器关闭连接\n", closed ? "[通过]" : "[失败]");
+    if (!closed) g_failures++;
+    fclose(in);
+    close(fd);
+
+    // 6) SIGTERM停止服务器（信号处理函数由server_run安装），套接字文件被删除
+    raise(SIGTERM);
+    void *ret = NULL;
+    pthread_join(tid, &ret);
+    int stopped = (*(int *)ret == 0 && access(TEST_SOCKET, F_OK) != 0);
+    printf("%s server_run 返回 %d，套接字文件已删除\n", stopped ? "[通过]" : "[失败]", *(int *)ret);
+    if (!stopped) g_failures++;
+
+    destroy_list(&head);
+    printf("\n失败 %d 项\n", g_failures);
+    return g_failures == 0 ? 0 : 1;
+}
@@ -1,8 +1,11 @@
 // tests/test_store.c
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "data.h"
 #include "store.h"
@@ -41,12 +44,66 @@ static void check_file(const char *path) {
     }
 }
 
+/* 文件大小，不存在时返回-1 */
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+/* 读入整个文件（调用方free），失败返回NULL */
+static unsigned char *read_file(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char *data = (len > 0) ? (unsigned char *)malloc((size_t)len) : NULL;
+    if (data && fread(data, 1, (size_t)len, fp) != (size_t)len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    *size = data ? (size_t)len : 0;
+    return data;
+}
+
+/* 文件中是否含有text */
+static int file_contains(const char *path, const char *text) {
+    size_t size, n = strlen(text);
+    unsigned char *data = read_file(path, &size);
+    int found = 0;
+    for (size_t i = 0; data && !found && i + n <= size; i++) found = (memcmp(data + i, text, n) == 0);
+    free(data);
+    return found;
+}
+
+static void write_file(const char *path, const unsigned char *data, size_t size) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return;
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+}
+
+/* 按小端写入u64（快照文件头的字段格式） */
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
 int main(void) {
     // 清理旧的借阅记录文件以便测试可重复
     remove("loan_records.bin");
     remove("test_books.csv");
     remove("test_books.json");
     remove("persist.json");
+    remove("compact.json");
+    remove("numbers.json");
+    remove("import.csv");
+    remove("roundtrip.csv");
+    remove("snapshot.bin");
+    remove("broken.bin");
+    remove("replay.json");
+    remove("during_failure.json");
+    remove("kind.json");
 
     // 手动构造链表： head -> b1 -> b2
     BookNode *head = create_book("9780001", "Book One", "Author A", 10, 1);
@@ -61,19 +118,27 @@ int main(void) {
 
     // 1) 导出 CSV
     printf("\n>> 导出 CSV: test_books.csv\n");
-    export_to_csv("test_books.csv", head);
+    printf("export_to_csv 返回 %d\n", export_to_csv("test_books.csv", head));
     check_file("test_books.csv");
+    // 目录不存在：返回-1，不向stdout打印
+    printf("导出到不存在的目录返回 %d（应为-1）\n", export_to_csv("no_such_dir/books.csv", head));
 
     // 2) 导出 JSON（外部导出）
     printf("\n>> 导出 JSON: test_books.json\n");
-    export_to_json("test_books.json", head);
+    printf("export_to_json 返回 %d\n", export_to_json("test_books.json", head));
     check_file("test_books.json");
+    printf("导出文件%s借阅日志检查点\n", file_contains("test_books.json", "checkpoint") ? "带有（错误）" : "不带");
+    printf("导出到不存在的目录返回 %d（应为-1）\n", export_to_json("no_such_dir/books.json", head));
 
     // 3) log_loan 写入二进制借阅记录
     printf("\n>> 写入借阅记录（log_loan）\n");
     log_loan("9780001", 2); // 给 Book One 借2本
     log_loan("9780001", 1); // 再借1本
     log_loan("9780002", 5); // 给 Book Two 借5本（可能使库存为负，用于测试）
+    // 批量写入：整批记录一次写盘
+    LoanEntry batch[] = {{"9780001", 1}, {"9780002", 1}};
+    printf("log_loan_batch 返回 %d\n", log_loan_batch(batch, 2));
+    loan_log_flush(); // log_loan带写缓冲，检查文件前先写盘
     check_file("loan_records.bin");
 
     // 4) 在 load_loans 之前打印当前状态
@@ -81,7 +146,7 @@ int main(void) {
 
     // 5) 调用 load_loans 更新链表（会读取 loan_records.bin 并更新 stock/loaned）
     printf("\n>> 加载借阅记录（load_loans）\n");
-    load_loans(head);
+    load_loans(head, stdout);
 
     // 6) 加载后打印，验证 stock/loaned 是否更新
     print_list(head, "加载借阅记录后");
@@ -103,6 +168,260 @@ int main(void) {
         printf("load_books_from_json 返回 NULL\n");
     }
 
+    // 8.1) 快照带有检查点：再次 load_loans 不应重复计入已保存的借阅
+    printf("\n>> 在恢复的链表上再次加载借阅记录（应跳过检查点之前的记录）\n");
+    log_loan("9780001", 1); // 检查点之后的新借阅，只有这一条会被回放
+    load_loans(loaded, stdout);
+    print_list(loaded, "回放检查点之后的记录后（Book One 应再借出1本）");
+
+    // 8.1.1) 只认持久化数据文件中的检查点：早先带检查点的导出文件被当作数据文件时，借阅日志照常回放
+    printf("\n>> 导出文件中的检查点被忽略\n");
+    for (int i = 0; i < 2; i++) {
+        const char *kind = (i == 0) ? "library" : "export";
+        FILE *kf = fopen("kind.json", "w");
+        if (kf) {
+            fprintf(kf, "{\"metadata\":{\"kind\":\"%s\",\"checkpoint\":{\"loan_seq\":1000000}},"
+                        "\"books\":[{\"isbn\":\"9780001\",\"title\":\"Book One\",\"author\":\"Author A\","
+                        "\"stock\":100,\"loaned\":0}]}", kind);
+            fclose(kf);
+        }
+        BookNode *kind_loaded = load_books_from_json("kind.json");
+        load_loans(kind_loaded, stdout);
+        printf("kind=%s：Book One 已借出 %d（%s）\n", kind, kind_loaded ? kind_loaded->loaned : -1,
+               (i == 0) ? "应为0，检查点之前的记录全部跳过" : "应大于0，借阅日志从头回放");
+        destroy_list(&kind_loaded);
+    }
+
+    // 8.2) 压缩日志：丢弃检查点之前的记录
+    printf("\n>> 压缩借阅记录（compact_loan_log）\n");
+    uint64_t seq = loan_log_seq();
+    if (persist_books_json("persist.json", loaded) == 0) {
+        printf("compact_loan_log 移除 %ld 条记录\n", compact_loan_log(seq, 0));
+    }
+    check_file("loan_records.bin");
+
+    // 8.3) 紧凑格式 + 需要转义的字符：写出后再读回，字段应保持不变
+    printf("\n>> 紧凑格式写出含转义字符的书目（write_books_json）\n");
+    BookNode *odd = create_book("9780003", "Quote \" Back\\ Tab\t", "Line\nBreak", 1, 0);
+    printf("write_books_json 返回 %d\n", write_books_json("compact.json", odd, JSON_STYLE_COMPACT));
+    BookNode *odd_loaded = load_books_from_json("compact.json");
+    printf("转义字符读回%s\n", (odd_loaded && strcmp(odd_loaded->title, odd->title) == 0 &&
+                                  strcmp(odd_loaded->author, odd->author) == 0) ? "一致" : "不一致");
+    destroy_list(&odd_loaded);
+    destroy_list(&odd);
+
+    // 8.3.1) 数字写法：整数走快速路径，带小数/指数的仍交给 strtod
+    printf("\n>> 读取各种数字写法的 JSON（load_books_from_json）\n");
+    FILE *nf = fopen("numbers.json", "w");
+    if (nf) {
+        fputs("{\"books\":[{\"isbn\":\"1\",\"title\":\"a\",\"author\":\"x\",\"stock\":0,\"loaned\":-0},"
+              "{\"isbn\":\"2\",\"title\":\"b\",\"author\":\"x\",\"stock\":123456789,\"loaned\":7.0},"
+              "{\"isbn\":\"3\",\"title\":\"c\",\"author\":\"x\",\"stock\":3e2,\"loaned\":99999999999999999}]}", nf);
+        fclose(nf);
+    }
+    BookNode *nums = load_books_from_json("numbers.json");
+    for (BookNode *n = nums; n != NULL; n = n->next) {
+        printf("ISBN %s：库存 %d，已借出 %d\n", n->isbn, n->stock, n->loaned);
+    }
+    destroy_list(&nums);
+
+    // 8.3.2) CSV导入：表头、引号字段（含逗号/换行/转义引号）、CRLF、空行、格式错误和重复ISBN
+    printf("\n>> 从 CSV 批量导入（import_from_csv）\n");
+    FILE *cf = fopen("import.csv", "wb");
+    if (cf) {
+        fputs("ISBN,书名,作者,库存,已借出\r\n"
+              "9781000000001,\"Hello, \"\"World\"\"\",Author A,3,1\r\n"
+              "\r\n"
+              "9781000000002,\"Two\nLines\",Author B,0,2\n"
+              "9781000000003,Bad Stock,Author C,x,0\n"
+              "9781000000001,Duplicate,Author D,1,0\n"
+              "9781000000004,\"Unclosed\"x,Author E,1,0\n"
+              "9781000000005,No Newline,Author F,7,0", cf);
+        fclose(cf);
+    }
+    BookNode *imported = NULL;
+    CsvImportStats stats;
+    printf("import_from_csv 返回 %d\n", import_from_csv("import.csv", &imported, &stats));
+    printf("记录 %zu 条，导入 %zu，重复 %zu，格式错误 %zu\n",
+           stats.rows, stats.imported, stats.duplicates, stats.invalid);
+    for (size_t i = 0; i < stats.invalid && i < CSV_MAX_WARNINGS; i++) {
+        printf("格式错误的记录：第%zu条\n", stats.invalid_records[i]);
+    }
+    printf("导入不存在的文件返回 %d（应为-1）\n", import_from_csv("no_such_file.csv", &imported, &stats));
+    print_list(imported, "从 CSV 导入的书目");
+
+    // 再导出并读回：含逗号/引号/换行的字段经引号转义后应原样恢复
+    export_to_csv("roundtrip.csv", imported);
+    BookNode *again = NULL;
+    import_from_csv("roundtrip.csv", &again, &stats);
+    int same = (stats.imported == 3 && stats.invalid == 0);
+    for (BookNode *a = imported; same && a != NULL; a = a->next) {
+        BookNode *b = search_by_isbn(again, a->isbn);
+        same = b != NULL && strcmp(a->title, b->title) == 0 && strcmp(a->author, b->author) == 0 &&
+               a->stock == b->stock && a->loaned == b->loaned;
+    }
+    printf("CSV导出后读回%s\n", same ? "一致" : "不一致");
+    destroy_list(&again);
+    destroy_list(&imported);
+
+    // 8.4) 二进制快照：写出后 mmap 读回，书目和 ISBN 索引应一致
+    printf("\n>> 写出并读回二进制快照（persist_books_snapshot / load_books_snapshot）\n");
+    printf("persist_books_snapshot 返回 %d\n", persist_books_snapshot("snapshot.bin", loaded));
+    check_file("snapshot.bin");
+    BookNode *snap = load_books_snapshot("snapshot.bin");
+    if (snap) {
+        print_list(snap, "从快照恢复的书目（顺序应与 loaded 相同）");
+        BookNode *hit = search_by_isbn(snap, "9780002");
+        printf("快照索引查找 9780002：%s\n", hit ? hit->title : "未找到");
+    } else {
+        printf("load_books_snapshot 返回 NULL\n");
+    }
+    destroy_list(&snap);
+
+    // 8.4.1) 截断或文件头偏移越界的快照：应拒绝加载，不能越界读取映射
+    printf("\n>> 加载损坏的二进制快照（应全部拒绝）\n");
+    size_t snap_size = 0;
+    unsigned char *snap_data = read_file("snapshot.bin", &snap_size);
+    if (snap_data) {
+        unsigned char *broken = (unsigned char *)malloc(snap_size);
+        const char *cases[] = {"截断到一半", "索引段偏移超出文件（容量乘积回绕）", "字符串堆大小超出文件", "图书数超出文件"};
+        for (int c = 0; c < 4; c++) {
+            memcpy(broken, snap_data, snap_size);
+            size_t len = snap_size;
+            if (c == 0) {
+                len = snap_size / 2;
+            } else if (c == 1) {
+                put_le64(broken + 40, ((uint64_t)snap_size + 8) & ~(uint64_t)7); // index_offset
+                put_le64(broken + 48, (UINT64_C(1) << 60) - 1);                   // capacity*16回绕
+            } else if (c == 2) {
+                put_le64(broken + 32, UINT32_MAX);                                // heap_size
+            } else {
+                put_le64(broken + 16, 1000000);                                   // count
+                put_le64(broken + 24, 88 + 1000000ull * 24);                      // 与count一致的heap_offset
+            }
+            write_file("broken.bin", broken, len);
+            BookNode *bad = load_books_snapshot("broken.bin");
+            printf("%s：%s\n", cases[c], bad ? "加载了（错误）" : "已拒绝");
+            destroy_list(&bad);
+        }
+        free(broken);
+        free(snap_data);
+    }
+
+    // 8.5) 借阅日志缓冲：没有后续借阅时由后台线程按时间间隔写盘；写盘失败时记录和序号都保留
+    printf("\n>> 借阅日志缓冲区的写盘时机与写盘失败\n");
+    loan_log_flush();
+    long log_size = file_size("loan_records.bin");
+    printf("log_loan 返回 %d\n", log_loan("9780001", 1));
+    sleep(4); // LOG_FLUSH_INTERVAL(2秒) + 后台线程的检查周期，期间没有新的借阅
+    printf("等待后无需再借阅即已写盘：%s\n", file_size("loan_records.bin") > log_size ? "是" : "否");
+
+    // 把文件大小上限设为当前大小，写盘必然失败（EFBIG）；先多记几条借阅，让日志比下面导出的小文件大
+    LoanEntry pad[8];
+    for (int i = 0; i < 8; i++) pad[i] = (LoanEntry){"9789999999999", 1}; // 不存在的图书，回放时忽略
+    log_loan_batch(pad, 8);
+    loan_log_flush();
+    log_size = file_size("loan_records.bin");
+    uint64_t seq_before = loan_log_seq();
+    struct rlimit old_limit, limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = (rlim_t)log_size;
+    signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &limit);
+    printf("log_loan 返回 %d\n", log_loan("9780002", 1));
+    printf("写盘失败时 loan_log_flush 返回 %d（应为-1）\n", loan_log_flush());
+    uint64_t seq_after = loan_log_seq();
+    printf("序号 %llu -> %llu（应加1，记录仍在缓冲区），文件大小%s\n",
+           (unsigned long long)seq_before, (unsigned long long)seq_after,
+           file_size("loan_records.bin") == log_size ? "不变" : "变了（错误）");
+    printf("写盘失败时保存快照返回 %d（应为-1）\n", persist_books_snapshot("never.bin", loaded));
+    printf("写盘失败时持久化JSON返回 %d（应为-1）\n", persist_books_json("never.json", loaded));
+    BookNode *tiny = create_book("1", "t", "a", 1, 0); // 导出文件小于文件大小上限
+    printf("写盘失败时紧凑导出返回 %d（应为0，导出不写借阅日志）\n",
+           write_books_json("during_failure.json", tiny, JSON_STYLE_COMPACT));
+    destroy_list(&tiny);
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    int flushed = loan_log_flush();
+    printf("恢复后 loan_log_flush 返回 %d，文件增加 %ld 字节（应为24）\n",
+           flushed, file_size("loan_records.bin") - log_size);
+
+    // 8.6) 并行回放：强制4个线程、每轮每线程只读64块（共约27轮），结果应与顺序回放逐本一致（含超出库存而跳过的借阅）
+    printf("\n>> 多线程分片回放与顺序回放对比\n");
+    BookNode *replay_src = NULL, **replay_tail = &replay_src;
+    char replay_isbn[20], replay_title[32];
+    for (int i = 0; i < 64; i++) {
+        // 每8本有一本ISBN不是纯数字，借阅记录要带续块
+        snprintf(replay_isbn, sizeof(replay_isbn), (i % 8 == 7) ? "X-%d" : "97870000%05d", i);
+        snprintf(replay_title, sizeof(replay_title), "Replay_%d", i);
+        *replay_tail = create_book(replay_isbn, replay_title, "Author R", 195, 0);
+        replay_tail = &(*replay_tail)->next;
+    }
+    persist_books_json("replay.json", replay_src); // 检查点在下面这批借阅之前
+    enum { REPLAY_LOANS = 6000 };
+    LoanEntry *loans = (LoanEntry *)malloc(REPLAY_LOANS * sizeof(LoanEntry));
+    char (*loan_isbns)[20] = malloc(REPLAY_LOANS * sizeof(*loan_isbns));
+    for (int i = 0; i < REPLAY_LOANS; i++) {
+        int book = (i * 7 + i / 64) % 64;
+        snprintf(loan_isbns[i], sizeof(loan_isbns[i]), (book % 8 == 7) ? "X-%d" : "97870000%05d", book);
+        loans[i].isbn = loan_isbns[i];
+        loans[i].quantity = 1 + i % 3; // 每本共借178~197本，库存195，最后几条借阅超出库存被跳过
+    }
+    printf("log_loan_batch 返回 %d\n", log_loan_batch(loans, REPLAY_LOANS));
+
+    loan_replay_config(1, 0, 0);
+    BookNode *sequential = load_books_from_json("replay.json");
+    load_loans(sequential, stdout);
+    uint64_t sequential_seq = loan_log_seq();
+    loan_replay_config(4, 0, 64);
+    BookNode *parallel = load_books_from_json("replay.json");
+    load_loans(parallel, stdout);
+    loan_replay_config(0, 8u << 20, 0);
+
+    int replay_same = (sequential != NULL && parallel != NULL && loan_log_seq() == sequential_seq);
+    long replay_loaned = 0;
+    for (BookNode *a = sequential, *b = parallel; replay_same && (a || b); a = a->next, b = b->next) {
+        replay_same = a && b && strcmp(a->isbn, b->isbn) == 0 && a->stock == b->stock && a->loaned == b->loaned;
+        if (replay_same) replay_loaned += a->loaned;
+    }
+    printf("并行回放与顺序回放%s，共借出 %ld 本\n", replay_same ? "一致" : "不一致", replay_loaned);
+    BookNode *replay_x = search_by_isbn(parallel, "X-7");
+    printf("并行回放后 X-7 库存 %d 已借出 %d\n", replay_x ? replay_x->stock : -1, replay_x ? replay_x->loaned : -1);
+    destroy_list(&sequential);
+    destroy_list(&parallel);
+
+    // 8.7) 并行回放中途失败：第1轮（4线程x64块）的段尾正好落在一条X-7记录的主块和续块之间，
+    //      第2轮按内存不足处理，其余记录顺序回放，序号和库存都应与顺序回放相同
+    printf("\n>> 并行回放失败后改为顺序回放（段尾落在续块前）\n");
+    persist_books_json("replay.json", replay_src);
+    for (int i = 0; i < 300; i++) {
+        snprintf(loan_isbns[i], sizeof(loan_isbns[i]), (i == 255) ? "X-7" : "97870000%05d", i % 7);
+        loans[i].isbn = loan_isbns[i];
+        loans[i].quantity = 1;
+    }
+    printf("log_loan_batch 返回 %d\n", log_loan_batch(loans, 300));
+    loan_replay_config(1, 0, 0);
+    sequential = load_books_from_json("replay.json");
+    load_loans(sequential, stdout);
+    sequential_seq = loan_log_seq();
+    loan_replay_config(4, 0, 64);
+    loan_replay_fail_round(2);
+    parallel = load_books_from_json("replay.json");
+    load_loans(parallel, stdout);
+    loan_replay_fail_round(0);
+    loan_replay_config(0, 8u << 20, 0);
+    replay_same = (sequential != NULL && parallel != NULL);
+    for (BookNode *a = sequential, *b = parallel; replay_same && (a || b); a = a->next, b = b->next) {
+        replay_same = a && b && a->stock == b->stock && a->loaned == b->loaned;
+    }
+    printf("借阅日志序号 %llu / %llu（应相同），库存%s\n", (unsigned long long)sequential_seq,
+           (unsigned long long)loan_log_seq(), replay_same ? "一致" : "不一致");
+    destroy_list(&replay_src);
+    destroy_list(&sequential);
+    destroy_list(&parallel);
+    free(loans);
+    free(loan_isbns);
+
     // 9) 清理内存（使用项目提供的 destroy_list）
     printf("\n>> 释放链表内存\n");
     destroy_list(&loaded);